@@ -10,6 +10,24 @@ public:
         *buffer = new CMediaBuffer(capacity);
         return S_OK;
     }
+    static CMediaBuffer *Create(DWORD capacity)
+    {
+        return new CMediaBuffer(capacity);
+    }
+    /*
+     * Grow the buffer to hold at least capacity bytes, discarding the
+     * content. Returns true when memory was (re)allocated.
+     */
+    bool Reserve(DWORD capacity)
+    {
+        m_count = 0;
+        if (capacity <= m_buffer.size())
+            return false;
+        std::vector<BYTE>(capacity).swap(m_buffer);
+        return true;
+    }
+    /* true if nobody else (the DMO) holds a reference */
+    bool IsExclusive() const { return m_refcount == 1; }
     STDMETHODIMP_(HRESULT) QueryInterface(REFIID riid, void **ppv)
     {
         if (riid == IID_IMediaBuffer || riid == IID_IUnknown) {
@@ -1,3 +1,4 @@
+#include <cmath>
 #include "MSResampler.h"
 #include "CMediaBuffer.h"
 #include "win32util.h"
@@ -53,14 +54,13 @@ namespace {
         mediaType->swap(result);
     }
 
-    std::shared_ptr<IMediaBuffer> createMediaBuffer(size_t size)
+    std::shared_ptr<CMediaBuffer> createMediaBuffer(size_t size)
     {
-        IMediaBuffer *bp;
-        CMediaBuffer::Create(size, &bp);
         struct Releaser {
             static void call(IUnknown *x) { x->Release(); }
         };
-        return std::shared_ptr<IMediaBuffer>(bp, Releaser::call);
+        return std::shared_ptr<CMediaBuffer>(CMediaBuffer::Create(size),
+                                             Releaser::call);
     }
 
     inline void throwIfError(HRESULT expr, const char *msg)
@@ -75,10 +75,12 @@ namespace {
 DMODSPProcessor::DMODSPProcessor(const std::shared_ptr<ISource> &src,
                                  const std::shared_ptr<IDMODSPEngine> &engine)
     : FilterBase(src),
-      m_engine(engine),
       m_state_pull(false),
+      m_eof(false),
       m_position(0),
-      m_length(~0ULL)
+      m_length(~0ULL),
+      m_engine(engine),
+      m_allocations(0)
 {
     const AudioStreamBasicDescription &iasbd = src->getSampleFormat();
     const AudioStreamBasicDescription &oasbd = m_engine->getSampleFormat();
@@ -87,43 +89,81 @@ DMODSPProcessor::DMODSPProcessor(const std::shared_ptr<ISource> &src,
         m_length = m_length * oasbd.mSampleRate / iasbd.mSampleRate + .5;
 }
 
+/*
+ * The DMO can return fewer frames than asked, or none while it is
+ * filling its filter; keep feeding it so that every call but the last
+ * one returns exactly nsamples.
+ */
 size_t DMODSPProcessor::readSamples(void *buffer, size_t nsamples)
+{
+    const AudioStreamBasicDescription &oasbd = m_engine->getSampleFormat();
+    uint8_t *bp = static_cast<uint8_t*>(buffer);
+    size_t count = 0;
+    while (count < nsamples) {
+        size_t n = process(bp + count * oasbd.mBytesPerFrame,
+                           nsamples - count);
+        if (!n && m_eof && !m_state_pull)
+            break;
+        count += n;
+    }
+    return count;
+}
+
+size_t DMODSPProcessor::process(void *buffer, size_t nsamples)
 {
     const AudioStreamBasicDescription &iasbd = source()->getSampleFormat();
     const AudioStreamBasicDescription &oasbd = m_engine->getSampleFormat();
     IMediaObject &mediaObject = m_engine->mediaObject();
-    if (!m_state_pull) {
-        size_t pullcount =
-            nsamples * iasbd.mSampleRate / oasbd.mSampleRate;
-        std::shared_ptr<IMediaBuffer> ibptr
-            = createMediaBuffer(iasbd.mBytesPerFrame * pullcount);
+    if (!m_state_pull && !m_eof) {
+        size_t pullcount = static_cast<size_t>(
+            std::ceil(nsamples * iasbd.mSampleRate / oasbd.mSampleRate));
+        CMediaBuffer *ibp =
+            prepareBuffer(&m_ibuffer, iasbd.mBytesPerFrame * pullcount);
         BYTE *bp;
-        ibptr->GetBufferAndLength(&bp, 0);
+        ibp->GetBufferAndLength(&bp, 0);
         size_t n = source()->readSamples(bp, pullcount);
         if (n > 0) {
-            ibptr->SetLength(n * iasbd.mBytesPerFrame);
-            HR(mediaObject.ProcessInput(0, ibptr.get(), 0, 0, 0));
+            ibp->SetLength(n * iasbd.mBytesPerFrame);
+            HR(mediaObject.ProcessInput(0, ibp, 0, 0, 0));
         } else {
             mediaObject.Discontinuity(0);
             m_state_pull = true;
+            m_eof = true;
         }
     }
     DMO_OUTPUT_DATA_BUFFER dodb = { 0 };
-    std::shared_ptr<IMediaBuffer> obptr
-        = createMediaBuffer(oasbd.mBytesPerFrame * nsamples);
-    dodb.pBuffer = obptr.get();
+    CMediaBuffer *obp =
+        prepareBuffer(&m_obuffer, oasbd.mBytesPerFrame * nsamples);
+    dodb.pBuffer = obp;
     DWORD status = 0;
     HR(mediaObject.ProcessOutput(0, 1, &dodb, &status));
     m_state_pull = (dodb.dwStatus & DMO_OUTPUT_DATA_BUFFERF_INCOMPLETE);
 
     BYTE *bp;
     DWORD size;
-    obptr->GetBufferAndLength(&bp, &size);
+    obp->GetBufferAndLength(&bp, &size);
     std::memcpy(buffer, bp, size);
     m_position += size / oasbd.mBytesPerFrame;
     return size / oasbd.mBytesPerFrame;
 }
 
+CMediaBuffer *
+DMODSPProcessor::prepareBuffer(std::shared_ptr<CMediaBuffer> *buffer,
+                               size_t size)
+{
+    /*
+     * The DMO is done with the input buffer when it asks for more,
+     * but don't touch it if it still holds a reference.
+     */
+    if (!buffer->get() || !(*buffer)->IsExclusive()) {
+        *buffer = createMediaBuffer(size);
+        ++m_allocations;
+    } else if ((*buffer)->Reserve(size)) {
+        ++m_allocations;
+    }
+    return buffer->get();
+}
+
 MSResampler::MSResampler(const std::shared_ptr<ISource> &src, int rate,
                          int quality, double bandwidth)
 {
@@ -8,17 +8,33 @@
 
 _COM_SMARTPTR_TYPEDEF(IMediaObject, __uuidof(IMediaObject));
 
+class CMediaBuffer;
+
 struct IDMODSPEngine {
     virtual ~IDMODSPEngine() {}
     virtual const AudioStreamBasicDescription &getSampleFormat() const = 0;
     virtual IMediaObjectPtr &mediaObject() = 0;
 };
 
+/*
+ * Input and output media buffers are kept across readSamples() calls.
+ * They grow to fit the largest request seen so far and are never shrunk,
+ * so once nsamples stops growing, readSamples() makes no heap
+ * allocation; allocationCount() tells how many times buffers were
+ * (re)allocated.
+ *
+ * length() is the input length converted to the output rate, an
+ * estimate: the DMO adds its own filter delay and tail.
+ */
 class DMODSPProcessor: public FilterBase {
     bool m_state_pull;
+    bool m_eof;
     int64_t m_position;
     uint64_t m_length;
     std::shared_ptr<IDMODSPEngine> m_engine;
+    std::shared_ptr<CMediaBuffer> m_ibuffer;
+    std::shared_ptr<CMediaBuffer> m_obuffer;
+    size_t m_allocations;
 public:
     DMODSPProcessor(const std::shared_ptr<ISource> &src, 
                     const std::shared_ptr<IDMODSPEngine> &engine);
@@ -29,6 +45,11 @@ public:
     }
     int64_t getPosition() { return m_position; }
     size_t readSamples(void *buffer, size_t nsamples);
+    size_t allocationCount() const { return m_allocations; }
+private:
+    size_t process(void *buffer, size_t nsamples);
+    CMediaBuffer *prepareBuffer(std::shared_ptr<CMediaBuffer> *buffer,
+                                size_t size);
 };
 
 class MSResampler: public IDMODSPEngine {
@@ -0,0 +1,147 @@
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+#include "NoiseShaper.h"
+#include "cpuinfo.h"
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) \
+    || defined(__x86_64__)
+#include <emmintrin.h>
+#define NOISESHAPER_X86 1
+#endif
+
+namespace {
+    const double kHighpass2Coefs[] = { 2.0, -1.0 };
+
+    /* Wannamaker's 9-tap F-weighted filter for 44.1kHz */
+    const double kFWeighted44Coefs[] = {
+        2.412, -3.370, 3.937, -4.174, 3.353, -2.205, 1.281, -0.569, 0.0847
+    };
+
+    /*
+     * Same weighting curve fitted for 48kHz (order 9 LPC of the inverse
+     * power response, which gives back the table above at 44.1kHz)
+     */
+    const double kFWeighted48Coefs[] = {
+        2.6136, -3.8110, 4.3035, -3.9818, 2.5851, -1.2041, 0.3517, 0.0555,
+        -0.1207
+    };
+
+    template <typename T>
+    inline double load(const T *src) { return *src; }
+
+#ifdef NOISESHAPER_X86
+    inline __m128d load2(const float *src)
+    {
+        return _mm_cvtps_pd(_mm_castsi128_ps(
+                _mm_loadl_epi64(reinterpret_cast<const __m128i*>(src))));
+    }
+
+    inline __m128d load2(const double *src)
+    {
+        return _mm_loadu_pd(src);
+    }
+#endif
+}
+
+NoiseShaper::NoiseShaper(Type type, double rate, unsigned nchannels)
+    : m_nchannels(nchannels),
+      m_pos(0),
+      m_sse2(cpuinfo::sse2())
+{
+    const double *coefs;
+    size_t ntaps;
+    if (type == kFWeighted && rate == 44100) {
+        coefs = kFWeighted44Coefs;
+        ntaps = sizeof(kFWeighted44Coefs) / sizeof(double);
+    } else if (type == kFWeighted && rate == 48000) {
+        coefs = kFWeighted48Coefs;
+        ntaps = sizeof(kFWeighted48Coefs) / sizeof(double);
+    } else if (type == kFWeighted || type == kHighpass2) {
+        coefs = kHighpass2Coefs;
+        ntaps = sizeof(kHighpass2Coefs) / sizeof(double);
+    } else {
+        throw std::runtime_error("NoiseShaper: invalid type");
+    }
+    m_coefs.assign(coefs, coefs + ntaps);
+    m_history.resize(2 * ntaps * nchannels);
+}
+
+void NoiseShaper::process(const float *src, const double *noise, int *dst,
+                          size_t nframes, unsigned depth)
+{
+    processT(src, noise, dst, nframes, depth);
+}
+
+void NoiseShaper::process(const double *src, const double *noise, int *dst,
+                          size_t nframes, unsigned depth)
+{
+    processT(src, noise, dst, nframes, depth);
+}
+
+/*
+ * Row m_pos + k of m_history holds the errors of k + 1 frames ago. Every
+ * error is written to two rows ntaps apart, so that the newest ntaps
+ * rows are always contiguous from m_pos.
+ * The new error of a channel overwrites the oldest one, which has already
+ * been read for that channel.
+ */
+template <typename T>
+void NoiseShaper::processT(const T *src, const double *noise, int *dst,
+                           size_t nframes, unsigned depth)
+{
+    const unsigned nch = m_nchannels;
+    const size_t ntaps = m_coefs.size();
+    const int shifts = 32 - depth;
+    const double scale = 1U << (depth - 1);
+    const double min_value = -scale;
+    const double max_value = scale - 1;
+    const double *h = &m_coefs[0];
+
+    for (size_t n = 0; n < nframes; ++n) {
+        const double *hist = &m_history[m_pos * nch];
+        size_t pos = (m_pos + ntaps - 1) % ntaps;
+        double *e0 = &m_history[pos * nch];
+        double *e1 = &m_history[(pos + ntaps) * nch];
+        unsigned ch = 0;
+#ifdef NOISESHAPER_X86
+        if (m_sse2) {
+            const __m128d vscale = _mm_set1_pd(scale);
+            const __m128d vmin = _mm_set1_pd(min_value);
+            const __m128d vmax = _mm_set1_pd(max_value);
+            const __m128i vshifts = _mm_cvtsi32_si128(shifts);
+            for (; ch + 2 <= nch; ch += 2) {
+                __m128d acc = _mm_setzero_pd();
+                for (size_t k = 0; k < ntaps; ++k)
+                    acc = _mm_add_pd(acc,
+                            _mm_mul_pd(_mm_set1_pd(h[k]),
+                                       _mm_loadu_pd(hist + k * nch + ch)));
+                __m128d v = _mm_sub_pd(_mm_mul_pd(load2(src + ch), vscale),
+                                       acc);
+                __m128d y = _mm_cvtepi32_pd(_mm_cvtpd_epi32(
+                        _mm_add_pd(v, _mm_loadu_pd(noise + ch))));
+                __m128d e = _mm_sub_pd(y, v);
+                _mm_storeu_pd(e0 + ch, e);
+                _mm_storeu_pd(e1 + ch, e);
+                y = _mm_min_pd(_mm_max_pd(y, vmin), vmax);
+                _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + ch),
+                                 _mm_sll_epi32(_mm_cvtpd_epi32(y), vshifts));
+            }
+        }
+#endif
+        for (; ch < nch; ++ch) {
+            double acc = 0.0;
+            for (size_t k = 0; k < ntaps; ++k)
+                acc += h[k] * hist[k * nch + ch];
+            double v = load(src + ch) * scale - acc;
+            double y = static_cast<double>(lrint(v + noise[ch]));
+            double e = y - v;
+            e0[ch] = e1[ch] = e;
+            y = std::min(std::max(y, min_value), max_value);
+            dst[ch] = static_cast<int>(y) << shifts;
+        }
+        m_pos = pos;
+        src += nch;
+        noise += nch;
+        dst += nch;
+    }
+}
@@ -0,0 +1,48 @@
+#ifndef NOISESHAPER_H
+#define NOISESHAPER_H
+
+#include <cstddef>
+#include <vector>
+#include <stdint.h>
+
+/*
+ * Quantizer with error feedback noise shaping.
+ * The rounding error of each channel is filtered by H(z) and subtracted
+ * from the following samples of the channel, so that the spectrum of the
+ * total error follows 1 - H(z). Error history is kept across calls.
+ *
+ * kHighpass2:  (1 - z^-1)^2, pushes noise up evenly at any rate.
+ * kFWeighted:  9-tap F-weighted curve (less noise where the ear is most
+ *              sensitive), for 44.1kHz and 48kHz; kHighpass2 otherwise.
+ *
+ * Channels are processed in pairs with SSE2 when available, with the
+ * same results as the scalar loop.
+ */
+class NoiseShaper {
+    unsigned m_nchannels;
+    std::vector<double> m_coefs;
+    /* 2 * taps rows of nchannels errors, see process() */
+    std::vector<double> m_history;
+    size_t m_pos;
+    bool m_sse2;
+public:
+    enum Type { kNone, kHighpass2, kFWeighted };
+
+    NoiseShaper(Type type, double rate, unsigned nchannels);
+
+    /*
+     * Quantizes nframes interleaved frames of [-1.0, 1.0) samples to depth
+     * bits, left aligned in 32bit. noise (in LSB, one per sample) is added
+     * before rounding.
+     */
+    void process(const float *src, const double *noise, int *dst,
+                 size_t nframes, unsigned depth);
+    void process(const double *src, const double *noise, int *dst,
+                 size_t nframes, unsigned depth);
+private:
+    template <typename T>
+    void processT(const T *src, const double *noise, int *dst,
+                  size_t nframes, unsigned depth);
+};
+
+#endif
@@ -0,0 +1,363 @@
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include "ParallelResampler.h"
+#include "cautil.h"
+
+/*
+ * Window of float (or double) frames read from the source, shared by the
+ * channel groups. Each group reads its own channels at its own position; frames
+ * are dropped once every group has gone past them.
+ */
+template <typename T>
+class ChannelSplitter {
+    std::shared_ptr<ISource> m_src;
+    std::mutex m_mutex;
+    util::AlignedBuffer m_pivot;
+    std::vector<T> m_window;
+    uint64_t m_base;
+    size_t m_frames;
+    bool m_eof;
+    std::vector<unsigned> m_first;
+    std::vector<unsigned> m_width;
+    std::vector<uint64_t> m_positions;
+public:
+    explicit ChannelSplitter(const std::shared_ptr<ISource> &src)
+        : m_src(src), m_base(0), m_frames(0), m_eof(false)
+    {}
+    const std::shared_ptr<ISource> &source() const { return m_src; }
+    size_t addGroup(unsigned first, unsigned width)
+    {
+        m_first.push_back(first);
+        m_width.push_back(width);
+        m_positions.push_back(0);
+        return m_positions.size() - 1;
+    }
+    unsigned first(size_t group) const { return m_first[group]; }
+    unsigned width(size_t group) const { return m_width[group]; }
+    uint64_t position(size_t group)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_positions[group];
+    }
+    size_t read(size_t group, T * const *channels, size_t nsamples);
+    bool isSeekable()
+    {
+        ISeekableSource *src = dynamic_cast<ISeekableSource*>(m_src.get());
+        return src && src->isSeekable();
+    }
+    void seek(size_t group, uint64_t position);
+};
+
+template <typename T>
+size_t ChannelSplitter<T>::read(size_t group, T * const *channels,
+                                size_t nsamples)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const unsigned nchannels = m_src->getSampleFormat().mChannelsPerFrame;
+    uint64_t pos = m_positions[group];
+
+    while (!m_eof && m_base + m_frames < pos + nsamples) {
+        size_t want =
+            static_cast<size_t>(pos + nsamples - m_base - m_frames);
+        if (m_window.size() < (m_frames + want) * nchannels)
+            m_window.resize((m_frames + want) * nchannels);
+        size_t n = readSamplesAsFloat(m_src.get(), &m_pivot,
+                                      &m_window[m_frames * nchannels], want);
+        if (!n)
+            m_eof = true;
+        m_frames += n;
+    }
+    size_t count = static_cast<size_t>(
+        std::min<uint64_t>(nsamples, m_base + m_frames - pos));
+    const T *src = &m_window[(pos - m_base) * nchannels + m_first[group]];
+    const unsigned width = m_width[group];
+    for (unsigned c = 0; c < width; ++c) {
+        const T *sp = src + c;
+        for (size_t i = 0; i < count; ++i, sp += nchannels)
+            channels[c][i] = *sp;
+    }
+    m_positions[group] = pos + count;
+
+    uint64_t low = *std::min_element(m_positions.begin(), m_positions.end());
+    if (low > m_base) {
+        size_t drop = static_cast<size_t>(low - m_base);
+        std::memmove(&m_window[0], &m_window[drop * nchannels],
+                     (m_frames - drop) * nchannels * sizeof(T));
+        m_frames -= drop;
+        m_base = low;
+    }
+    return count;
+}
+
+/*
+ * Groups are expected to seek to the same position one after another.
+ * The window is discarded when the position is outside of it.
+ */
+template <typename T>
+void ChannelSplitter<T>::seek(size_t group, uint64_t position)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (position < m_base || position > m_base + m_frames) {
+        dynamic_cast<ISeekableSource*>(m_src.get())->seekTo(position);
+        m_base = position;
+        m_frames = 0;
+        m_eof = false;
+    }
+    m_positions[group] = position;
+}
+
+namespace {
+    /* float (or double) source of the channels of one group */
+    template <typename T>
+    class ChannelGroupSource: public ISeekableSource, public IPlanarSource<T>
+    {
+        std::shared_ptr<ChannelSplitter<T> > m_splitter;
+        size_t m_group;
+        AudioStreamBasicDescription m_asbd;
+        std::vector<std::vector<T> > m_buffers;
+        std::vector<T*> m_planes;
+    public:
+        ChannelGroupSource(
+                const std::shared_ptr<ChannelSplitter<T> > &splitter,
+                size_t group)
+            : m_splitter(splitter), m_group(group)
+        {
+            const AudioStreamBasicDescription &asbd =
+                splitter->source()->getSampleFormat();
+            m_asbd = cautil::buildASBDForPCM(asbd.mSampleRate,
+                                             splitter->width(group),
+                                             sizeof(T) * 8,
+                                             kAudioFormatFlagIsFloat);
+        }
+        uint64_t length() const { return m_splitter->source()->length(); }
+        const AudioStreamBasicDescription &getSampleFormat() const
+        {
+            return m_asbd;
+        }
+        const std::vector<uint32_t> *getChannels() const { return 0; }
+        int64_t getPosition() { return m_splitter->position(m_group); }
+        size_t readSamples(void *buffer, size_t nsamples)
+        {
+            const unsigned width = m_splitter->width(m_group);
+            m_buffers.resize(width);
+            m_planes.resize(width);
+            for (unsigned c = 0; c < width; ++c) {
+                if (m_buffers[c].size() < nsamples)
+                    m_buffers[c].resize(nsamples);
+                m_planes[c] = &m_buffers[c][0];
+            }
+            nsamples = m_splitter->read(m_group, &m_planes[0], nsamples);
+            util::interleave(&m_planes[0], static_cast<T*>(buffer),
+                             width, nsamples);
+            return nsamples;
+        }
+        size_t readPlanar(T * const *channels, size_t nsamples)
+        {
+            return m_splitter->read(m_group, channels, nsamples);
+        }
+        bool isSeekable() { return m_splitter->isSeekable(); }
+        void seekTo(int64_t position)
+        {
+            m_splitter->seek(m_group, position);
+        }
+    };
+}
+
+template <typename T>
+ParallelResamplerT<T>::ParallelResamplerT(
+        const std::shared_ptr<ISource> &src, int rate, int quality,
+        double bandwidth, bool minphase,
+        const std::shared_ptr<ThreadPool> &pool)
+    : FilterBase(src),
+      m_pool(pool),
+      m_splitter(std::make_shared<ChannelSplitter<T> >(src)),
+      m_position(0)
+{
+    const unsigned nchannels = src->getSampleFormat().mChannelsPerFrame;
+    m_asbd = cautil::buildASBDForPCM(rate, nchannels, sizeof(T) * 8,
+                                     kAudioFormatFlagIsFloat);
+    for (unsigned ch = 0; ch < nchannels; ch += kGroupChannels) {
+        unsigned width = std::min<unsigned>(kGroupChannels, nchannels - ch);
+        size_t group = m_splitter->addGroup(ch, width);
+        std::shared_ptr<ISource> gsrc =
+            std::make_shared<ChannelGroupSource<T> >(m_splitter, group);
+        m_resamplers.push_back(createPolyphaseResampler<T>(gsrc, rate,
+                                                           quality,
+                                                           bandwidth,
+                                                           minphase));
+    }
+    m_outputs.resize(nchannels);
+    m_planes.resize(nchannels);
+    m_counts.resize(m_resamplers.size());
+}
+
+template <typename T>
+size_t ParallelResamplerT<T>::readSamples(void *buffer, size_t nsamples)
+{
+    const unsigned nchannels = m_asbd.mChannelsPerFrame;
+    for (unsigned c = 0; c < nchannels; ++c) {
+        if (m_outputs[c].size() < nsamples)
+            m_outputs[c].resize(nsamples);
+        m_planes[c] = &m_outputs[c][0];
+    }
+    size_t count = readPlanar(&m_planes[0], nsamples);
+    util::interleave(&m_planes[0], static_cast<T*>(buffer), nchannels,
+                     count);
+    return count;
+}
+
+template <typename T>
+size_t ParallelResamplerT<T>::readPlanar(T * const *channels,
+                                         size_t nsamples)
+{
+    std::function<void(size_t)> task = [&](size_t i) {
+        m_counts[i] = m_resamplers[i]->readPlanar(
+                channels + m_splitter->first(i), nsamples);
+    };
+    if (m_pool)
+        m_pool->run(m_resamplers.size(), task);
+    else
+        for (size_t i = 0; i < m_resamplers.size(); ++i)
+            task(i);
+    size_t count = m_counts[0];
+    for (size_t i = 1; i < m_counts.size(); ++i)
+        if (m_counts[i] != count)
+            throw std::runtime_error("ParallelResampler: "
+                                     "channel groups out of sync");
+    m_position += count;
+    return count;
+}
+
+template <typename T>
+void ParallelResamplerT<T>::seekTo(int64_t position)
+{
+    for (size_t i = 0; i < m_resamplers.size(); ++i)
+        m_resamplers[i]->seekTo(position);
+    m_position = position;
+}
+
+template class ParallelResamplerT<float>;
+template class ParallelResamplerT<double>;
+
+SegmentedResampler::SegmentedResampler(
+        const std::vector<std::shared_ptr<ISeekableSource> > &sources,
+        int rate, int quality, double bandwidth, bool float64,
+        bool minphase, size_t segment_frames)
+    : m_sources(sources),
+      m_pool(std::make_shared<ThreadPool>(
+                 static_cast<unsigned>(sources.size()))),
+      m_segment_frames(segment_frames),
+      m_head(0),
+      m_next(0),
+      m_position(0),
+      m_eof(false)
+{
+    for (size_t i = 0; i < m_sources.size(); ++i) {
+        m_resamplers.push_back(
+            createNativeResampler(m_sources[i], rate, quality, bandwidth,
+                                  std::shared_ptr<ThreadPool>(), float64,
+                                  minphase));
+        if (!m_resamplers[i]->isSeekable())
+            throw std::runtime_error("SegmentedResampler: "
+                                     "input is not seekable");
+        m_segments.push_back(std::make_shared<Segment>());
+    }
+    uint64_t len = length();
+    m_nsegments = len == ~0ULL ? ~0ULL
+                               : (len + segment_frames - 1) / segment_frames;
+    for (size_t i = 0; i < m_segments.size(); ++i)
+        start(i);
+}
+
+SegmentedResampler::~SegmentedResampler()
+{
+    for (size_t i = 0; i < m_segments.size(); ++i)
+        if (m_segments[i]->done.valid())
+            m_segments[i]->done.wait();
+}
+
+size_t SegmentedResampler::readSamples(void *buffer, size_t nsamples)
+{
+    const unsigned bpf = getSampleFormat().mBytesPerFrame;
+    uint8_t *op = static_cast<uint8_t*>(buffer);
+    size_t count = 0;
+
+    while (count < nsamples && !m_eof) {
+        Segment &seg = *m_segments[m_head];
+        if (!seg.done.valid() && seg.offset == seg.count) {
+            m_eof = true;
+            break;
+        }
+        if (seg.done.valid())
+            seg.done.get();
+        size_t n = std::min(nsamples - count, seg.count - seg.offset);
+        std::memcpy(op + count * bpf, &seg.data[seg.offset * bpf], n * bpf);
+        count += n;
+        seg.offset += n;
+        if (seg.offset < seg.count)
+            break;
+        /* a short segment is the last one */
+        if (seg.count < m_segment_frames) {
+            m_eof = true;
+            break;
+        }
+        start(m_head);
+        m_head = (m_head + 1) % m_segments.size();
+    }
+    m_position += count;
+    return count;
+}
+
+/* queue the next segment, if any, on the slot */
+void SegmentedResampler::start(size_t slot)
+{
+    Segment &seg = *m_segments[slot];
+    seg.count = seg.offset = 0;
+    if (m_next >= m_nsegments)
+        return;
+    seg.done = m_pool->submit(std::bind(&SegmentedResampler::run, this,
+                                        slot, m_next++));
+}
+
+void SegmentedResampler::run(size_t slot, uint64_t index)
+{
+    Segment &seg = *m_segments[slot];
+    FilterBase *resampler = m_resamplers[slot].get();
+    const unsigned bpf = resampler->getSampleFormat().mBytesPerFrame;
+    if (seg.data.size() < m_segment_frames * bpf)
+        seg.data.resize(m_segment_frames * bpf);
+
+    resampler->seekTo(index * m_segment_frames);
+    size_t n;
+    while (seg.count < m_segment_frames &&
+           (n = resampler->readSamples(&seg.data[seg.count * bpf],
+                                       m_segment_frames - seg.count)) > 0)
+        seg.count += n;
+}
+
+std::shared_ptr<FilterBase>
+createNativeResampler(const std::shared_ptr<ISource> &src, int rate,
+                      int quality, double bandwidth,
+                      const std::shared_ptr<ThreadPool> &pool, bool float64,
+                      bool minphase)
+{
+    /*
+     * Multichannel input is always split into the same channel groups,
+     * so that the output doesn't depend on the number of threads.
+     */
+    if (src->getSampleFormat().mChannelsPerFrame >
+        ParallelResampler::kGroupChannels) {
+        if (float64)
+            return std::make_shared<ParallelResampler64>(src, rate, quality,
+                                                         bandwidth, minphase,
+                                                         pool);
+        return std::make_shared<ParallelResampler>(src, rate, quality,
+                                                   bandwidth, minphase, pool);
+    }
+    if (float64)
+        return createPolyphaseResampler<double>(src, rate, quality,
+                                                bandwidth, minphase);
+    return createPolyphaseResampler<float>(src, rate, quality, bandwidth,
+                                           minphase);
+}
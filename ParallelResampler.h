@@ -0,0 +1,124 @@
+#ifndef PARALLELRESAMPLER_H
+#define PARALLELRESAMPLER_H
+
+#include "iointer.h"
+#include "ThreadPool.h"
+#include "PolyphaseResampler.h"
+
+template <typename T> class ChannelSplitter;
+
+/*
+ * Runs createPolyphaseResampler() on groups of channels in parallel.
+ * Channels are split into fixed groups of kGroupChannels (the last one can
+ * be narrower), each group is resampled by its own chain on the pool, and
+ * the results are interleaved again.
+ *
+ * Grouping doesn't depend on the number of threads, so the output is
+ * identical whatever the size of the pool is. Without a pool, groups are
+ * processed in turn on the calling thread.
+ *
+ * Groups are read and resampled planar, each chain writing straight into
+ * the planes of its channels; frames are interleaved only by
+ * readSamples(). T is the sample type, as of PolyphaseResamplerT.
+ *
+ * Seekable when the source is.
+ */
+template <typename T>
+class ParallelResamplerT: public FilterBase, public IPlanarSource<T>,
+    public ILatencyReporter
+{
+    AudioStreamBasicDescription m_asbd;
+    std::shared_ptr<ThreadPool> m_pool;
+    std::shared_ptr<ChannelSplitter<T> > m_splitter;
+    std::vector<std::shared_ptr<PolyphaseResamplerT<T> > > m_resamplers;
+    std::vector<std::vector<T> > m_outputs;
+    std::vector<T*> m_planes;
+    std::vector<size_t> m_counts;
+    int64_t m_position;
+public:
+    enum { kGroupChannels = 2 };
+
+    ParallelResamplerT(const std::shared_ptr<ISource> &src, int rate,
+                       int quality, double bandwidth, bool minphase,
+                       const std::shared_ptr<ThreadPool> &pool);
+    uint64_t length() const { return m_resamplers[0]->length(); }
+    const AudioStreamBasicDescription &getSampleFormat() const
+    {
+        return m_asbd;
+    }
+    int64_t getPosition() { return m_position; }
+    size_t readSamples(void *buffer, size_t nsamples);
+    size_t readPlanar(T * const *channels, size_t nsamples);
+    bool isSeekable() { return m_resamplers[0]->isSeekable(); }
+    void seekTo(int64_t position);
+    double latency() const { return m_resamplers[0]->latency(); }
+};
+
+typedef ParallelResamplerT<float> ParallelResampler;
+typedef ParallelResamplerT<double> ParallelResampler64;
+
+/*
+ * Resamples consecutive time segments of a seekable input concurrently,
+ * and returns them in order.
+ * Each of sources must be an independent reader of the same input, and
+ * is used by one segment at a time, so that up to sources.size() segments
+ * are in flight. A segment starts by seekTo() of its own resampler, which
+ * reads the filter length of pre-roll before the segment; therefore the
+ * output is bit-identical to resampling the whole input in one go.
+ */
+class SegmentedResampler: public ISource, public ILatencyReporter {
+    struct Segment {
+        std::vector<uint8_t> data;
+        size_t count;
+        size_t offset;
+        std::future<void> done;
+    };
+    std::vector<std::shared_ptr<ISeekableSource> > m_sources;
+    std::vector<std::shared_ptr<FilterBase> > m_resamplers;
+    std::vector<std::shared_ptr<Segment> > m_segments;
+    std::shared_ptr<ThreadPool> m_pool;
+    size_t m_segment_frames;
+    size_t m_head;
+    uint64_t m_next;
+    uint64_t m_nsegments;
+    int64_t m_position;
+    bool m_eof;
+public:
+    SegmentedResampler(
+        const std::vector<std::shared_ptr<ISeekableSource> > &sources,
+        int rate, int quality, double bandwidth, bool float64=false,
+        bool minphase=false, size_t segment_frames=1 << 18);
+    ~SegmentedResampler();
+    uint64_t length() const { return m_resamplers[0]->length(); }
+    const AudioStreamBasicDescription &getSampleFormat() const
+    {
+        return m_resamplers[0]->getSampleFormat();
+    }
+    const std::vector<uint32_t> *getChannels() const
+    {
+        return m_sources[0]->getChannels();
+    }
+    int64_t getPosition() { return m_position; }
+    size_t readSamples(void *buffer, size_t nsamples);
+    double latency() const
+    {
+        return dynamic_cast<ILatencyReporter&>(*m_resamplers[0]).latency();
+    }
+private:
+    void start(size_t slot);
+    void run(size_t slot, uint64_t index);
+};
+
+/*
+ * The built-in resampler: multichannel input goes to ParallelResampler,
+ * mono and stereo to a plain cascade. pool can be empty.
+ * Processing and output are in double when float64 is set, and filters
+ * are minimum phase when minphase is.
+ */
+std::shared_ptr<FilterBase>
+    createNativeResampler(const std::shared_ptr<ISource> &src, int rate,
+                          int quality, double bandwidth,
+                          const std::shared_ptr<ThreadPool> &pool,
+                          bool float64=false, bool minphase=false);
+
+#endif
@@ -0,0 +1,628 @@
+#include <cmath>
+#include <complex>
+#include "PolyphaseResampler.h"
+#include "cautil.h"
+#include "filtercache.h"
+
+namespace {
+    const double PI = 3.14159265358979323846;
+
+    /* zeroth order modified Bessel function of the first kind */
+    double bessel_i0(double x)
+    {
+        double sum = 1.0, term = 1.0, y = x * x / 4.0;
+        for (int k = 1; k < 500 && term > sum * 1e-21; ++k) {
+            term *= y / (static_cast<double>(k) * k);
+            sum += term;
+        }
+        return sum;
+    }
+
+    /* Kaiser's empirical formula: stopband attenuation (dB) -> beta */
+    double kaiser_beta(double attenuation)
+    {
+        if (attenuation > 50.0)
+            return 0.1102 * (attenuation - 8.7);
+        else if (attenuation > 21.0)
+            return 0.5842 * std::pow(attenuation - 21.0, 0.4)
+                 + 0.07886 * (attenuation - 21.0);
+        return 0.0;
+    }
+
+    inline double sinc(double x)
+    {
+        return x == 0.0 ? 1.0 : std::sin(PI * x) / (PI * x);
+    }
+
+    uint64_t gcd(uint64_t a, uint64_t b)
+    {
+        while (b) {
+            uint64_t t = a % b;
+            a = b;
+            b = t;
+        }
+        return a;
+    }
+
+    /* in place radix-2 FFT, size of x is a power of 2 */
+    void fft(std::vector<std::complex<double> > *x, bool inverse)
+    {
+        std::vector<std::complex<double> > &v = *x;
+        const size_t n = v.size();
+        for (size_t i = 1, j = 0; i < n; ++i) {
+            size_t bit = n >> 1;
+            for (; j & bit; bit >>= 1)
+                j ^= bit;
+            j ^= bit;
+            if (i < j)
+                std::swap(v[i], v[j]);
+        }
+        std::vector<std::complex<double> > twiddle(n / 2);
+        const double sign = inverse ? 2.0 * PI : -2.0 * PI;
+        for (size_t i = 0; i < n / 2; ++i)
+            twiddle[i] = std::polar(1.0, sign * i / n);
+        for (size_t len = 2; len <= n; len <<= 1) {
+            const size_t step = n / len;
+            for (size_t i = 0; i < n; i += len) {
+                for (size_t k = 0; k < len / 2; ++k) {
+                    std::complex<double> a = v[i + k];
+                    std::complex<double> b =
+                        v[i + k + len / 2] * twiddle[k * step];
+                    v[i + k] = a + b;
+                    v[i + k + len / 2] = a - b;
+                }
+            }
+        }
+        if (inverse)
+            for (size_t i = 0; i < n; ++i)
+                v[i] /= static_cast<double>(n);
+    }
+
+    /*
+     * Minimum phase filter with the magnitude response of h, by folding
+     * the real cepstrum. The FFT is a few times longer than h to keep
+     * the cepstral aliasing low; the result is truncated to the length
+     * of h, most of the energy is at its head.
+     */
+    void minimumPhase(std::vector<double> *h)
+    {
+        size_t n = 1;
+        while (n < h->size() * 4)
+            n <<= 1;
+        std::vector<std::complex<double> > x(n);
+        std::copy(h->begin(), h->end(), x.begin());
+        fft(&x, false);
+
+        double peak = 0.0;
+        for (size_t i = 0; i < n; ++i)
+            peak = std::max(peak, std::abs(x[i]));
+        /* stopband zeros would be log(0) */
+        const double floor = peak * 1e-12;
+        for (size_t i = 0; i < n; ++i)
+            x[i] = std::log(std::max(std::abs(x[i]), floor));
+        fft(&x, true);
+
+        /* causal part of the cepstrum */
+        for (size_t i = 1; i < n / 2; ++i)
+            x[i] *= 2.0;
+        for (size_t i = n / 2 + 1; i < n; ++i)
+            x[i] = 0.0;
+        fft(&x, false);
+        for (size_t i = 0; i < n; ++i)
+            x[i] = std::exp(x[i]);
+        fft(&x, true);
+        for (size_t i = 0; i < h->size(); ++i)
+            (*h)[i] = x[i].real();
+    }
+
+    /* beyond this, phases are interpolated from a table of kPhases */
+    const uint32_t kMaxExactPhases = 1024;
+    const uint32_t kPhases = 256;
+
+    /* extra attenuation (dB) of halfband stages in a cascade */
+    const double kStageMargin = 30.0;
+
+    /* firkernel entry for the sample type */
+    inline void convolvePlanar(const firkernel::Kernel *kernel,
+                               const float *coefs, const float * const *x,
+                               size_t index, unsigned ntaps,
+                               unsigned nchannels, float * const *out,
+                               size_t offset)
+    {
+        kernel->convolvePlanar(coefs, x, index, ntaps, nchannels, out,
+                               offset);
+    }
+
+    inline void convolvePlanar(const firkernel::Kernel *kernel,
+                               const float *coefs, const double * const *x,
+                               size_t index, unsigned ntaps,
+                               unsigned nchannels, double * const *out,
+                               size_t offset)
+    {
+        kernel->convolvePlanar64(coefs, x, index, ntaps, nchannels, out,
+                                 offset);
+    }
+
+    inline void decimateHalfband(const firkernel::Kernel *kernel,
+                                 const float *coefs, unsigned ntaps,
+                                 float center, unsigned cpos,
+                                 const float *x, float *out, size_t count)
+    {
+        kernel->decimateHalfband(coefs, ntaps, center, cpos, x, out, count);
+    }
+
+    inline void decimateHalfband(const firkernel::Kernel *kernel,
+                                 const float *coefs, unsigned ntaps,
+                                 float center, unsigned cpos,
+                                 const double *x, double *out, size_t count)
+    {
+        kernel->decimateHalfband64(coefs, ntaps, center, cpos, x, out,
+                                   count);
+    }
+}
+
+PolyphaseFilter::PolyphaseFilter(double in_rate, double out_rate,
+                                 int quality, double bandwidth,
+                                 unsigned nphases, bool minphase, bool wide)
+    : m_nphases(nphases),
+      m_ntaps(0),
+      m_minphase(minphase),
+      m_halfband(false),
+      m_group_delay(0.0),
+      m_coefs(0)
+{
+    /*
+     * Frequencies are normalized to the input Nyquist frequency.
+     * When downsampling, the filter is stretched by in_rate / out_rate
+     * so that quality stays the number of zero crossings per side
+     * at the output rate.
+     * Cutoff is at bandwidth, and stopband starts at the (lower) Nyquist
+     * frequency.
+     */
+    double scale = std::min(1.0, out_rate / in_rate);
+    unsigned half = static_cast<unsigned>(std::ceil(quality / scale));
+    double att = attenuation(in_rate, out_rate, quality, bandwidth);
+    if (!wide) {
+        design(half, scale * bandwidth, att);
+        return;
+    }
+    /*
+     * Same passband edge and attenuation, cutoff at the Nyquist frequency
+     * and stopband up to its mirror image; Kaiser's formula for the length.
+     */
+    double transition = 4.0 * scale * (1.0 - bandwidth);
+    double length = (att - 8.0) / (2.285 * PI * transition) + 1.0;
+    half = std::max(2U, static_cast<unsigned>(std::ceil(length / 2.0)));
+    design(half, scale, att);
+}
+
+/*
+ * Attenuation achievable with the length and transition width of the
+ * filter, which determines the window shape.
+ */
+double PolyphaseFilter::attenuation(double in_rate, double out_rate,
+                                    int quality, double bandwidth)
+{
+    double scale = std::min(1.0, out_rate / in_rate);
+    unsigned ntaps = 2 * static_cast<unsigned>(std::ceil(quality / scale));
+    double transition = 2.0 * scale * (1.0 - bandwidth);
+    double attenuation = 8.0 + 2.285 * PI * transition * (ntaps - 1);
+    return std::min(attenuation, 180.0);
+}
+
+std::shared_ptr<const PolyphaseFilter>
+PolyphaseFilter::halfband(double attenuation, double transition,
+                          bool minphase)
+{
+    /* Kaiser's formula for the length */
+    double length = (attenuation - 8.0) / (2.285 * PI * transition) + 1.0;
+    unsigned half = std::max(2U, static_cast<unsigned>(length / 2.0 + 1.0));
+    std::shared_ptr<PolyphaseFilter> filter(new PolyphaseFilter(1, minphase));
+    filter->design(half, 0.5, attenuation);
+    /* minimum phase conversion fills the zeros */
+    filter->m_halfband = !minphase;
+    return filter;
+}
+
+void PolyphaseFilter::design(unsigned half, double cutoff,
+                             double attenuation)
+{
+    m_ntaps = half * 2;
+    double beta = kaiser_beta(attenuation);
+    double i0beta = bessel_i0(beta);
+
+    /*
+     * Prototype at nphases times the rate, indexed by the time of the
+     * output after the input sample, in 1/nphases: phase(n)[k] is at
+     * n + (ntaps - 1 - k) * nphases.
+     */
+    std::vector<double> proto(m_ntaps * m_nphases + 1);
+    for (unsigned n = 0; n <= m_nphases; ++n) {
+        double phase = static_cast<double>(n) / m_nphases;
+        for (unsigned k = 0; k < m_ntaps; ++k) {
+            double t = phase + (half - 1) - k;
+            double r = t / half;
+            double w = r * r < 1.0
+                ? bessel_i0(beta * std::sqrt(1.0 - r * r)) / i0beta : 0.0;
+            proto[n + (m_ntaps - 1 - k) * m_nphases] =
+                cutoff * sinc(cutoff * t) * w;
+        }
+    }
+    if (m_minphase)
+        minimumPhase(&proto);
+
+    std::shared_ptr<std::vector<float> >
+        coefs(std::make_shared<std::vector<float> >(size()));
+    m_storage = coefs;
+    m_coefs = &(*coefs)[0];
+
+    double sum = 0.0;
+    for (unsigned n = 0; n <= m_nphases; ++n) {
+        float *row = &(*coefs)[n * m_ntaps];
+        for (unsigned k = 0; k < m_ntaps; ++k) {
+            double h = proto[n + (m_ntaps - 1 - k) * m_nphases];
+            row[k] = static_cast<float>(h);
+            if (n < m_nphases)
+                sum += h;
+        }
+    }
+    /* normalize for unity DC gain; zero cutoff passes nothing */
+    if (sum == 0.0)
+        throw std::runtime_error("PolyphaseFilter: bandwidth is too narrow");
+    float gain = static_cast<float>(m_nphases / sum);
+    for (size_t i = 0; i < coefs->size(); ++i)
+        (*coefs)[i] *= gain;
+    measure();
+}
+
+/* centroid of the coefficients, which is the group delay at DC */
+void PolyphaseFilter::measure()
+{
+    double sum = 0.0, moment = 0.0;
+    for (unsigned n = 0; n < m_nphases; ++n) {
+        const float *row = phase(n);
+        for (unsigned k = 0; k < m_ntaps; ++k) {
+            double j = n + static_cast<double>(m_ntaps - 1 - k) * m_nphases;
+            sum += row[k];
+            moment += row[k] * j;
+        }
+    }
+    m_group_delay = sum != 0.0 ? moment / sum / m_nphases : 0.0;
+}
+
+template <typename T>
+PolyphaseResamplerT<T>::PolyphaseResamplerT(
+        const std::shared_ptr<ISource> &src, int rate, int quality,
+        double bandwidth, bool minphase, const PolyphaseResamplerT *head)
+    : FilterBase(src),
+      m_position(0),
+      m_end(~0ULL),
+      m_consumed(0),
+      m_head(head ? head : this),
+      m_phase(0),
+      m_index(0),
+      m_frames(0),
+      m_ahead(0)
+{
+    init(rate);
+    const AudioStreamBasicDescription &iasbd = src->getSampleFormat();
+    /* the last stage of a cascade has a wide transition */
+    m_filter = filtercache::get(iasbd.mSampleRate, rate, quality, bandwidth,
+                                m_L <= kMaxExactPhases ? m_L : kPhases,
+                                minphase, head != 0);
+    m_coefs.resize(m_filter->ntaps());
+
+    /* prime with zeros so that the first output is centered at input 0 */
+    m_frames = m_filter->delay();
+    m_history.assign(m_asbd.mChannelsPerFrame,
+                     std::vector<T>(m_frames));
+}
+
+template <typename T>
+PolyphaseResamplerT<T>::PolyphaseResamplerT(
+        const std::shared_ptr<ISource> &src, int rate,
+        const std::shared_ptr<const PolyphaseFilter> &filter,
+        const PolyphaseResamplerT *head)
+    : FilterBase(src),
+      m_filter(filter),
+      m_position(0),
+      m_end(~0ULL),
+      m_consumed(0),
+      m_head(head ? head : this),
+      m_phase(0),
+      m_index(0),
+      m_frames(0),
+      m_ahead(0)
+{
+    init(rate);
+    m_coefs.resize(m_filter->ntaps());
+    if (m_filter->isHalfband()) {
+        /* taps of the parity other than the center, the rest are zero */
+        const float *row = m_filter->phase(0);
+        unsigned ntaps = m_filter->ntaps();
+        m_coefs.clear();
+        for (unsigned k = ntaps / 2 % 2; k < ntaps; k += 2)
+            m_coefs.push_back(row[k]);
+    }
+    m_frames = m_filter->delay();
+    m_history.assign(m_asbd.mChannelsPerFrame,
+                     std::vector<T>(m_frames));
+}
+
+template <typename T>
+void PolyphaseResamplerT<T>::init(int rate)
+{
+    const AudioStreamBasicDescription &iasbd = source()->getSampleFormat();
+    m_asbd = cautil::buildASBDForPCM(rate, iasbd.mChannelsPerFrame,
+                                     sizeof(T) * 8, kAudioFormatFlagIsFloat);
+    m_kernel = &firkernel::get();
+    m_output.resize(iasbd.mChannelsPerFrame);
+    m_output_planes.resize(iasbd.mChannelsPerFrame);
+    m_window.resize(iasbd.mChannelsPerFrame);
+    m_planes.resize(iasbd.mChannelsPerFrame);
+
+    uint64_t irate = static_cast<uint64_t>(iasbd.mSampleRate + .5);
+    uint64_t g = gcd(irate, rate);
+    m_L = static_cast<uint32_t>(rate / g);
+    m_M = static_cast<uint32_t>(irate / g);
+
+    const AudioStreamBasicDescription &hasbd =
+        m_head->sourcePtr()->getSampleFormat();
+    irate = static_cast<uint64_t>(hasbd.mSampleRate + .5);
+    g = gcd(irate, rate);
+    m_head_L = static_cast<uint32_t>(rate / g);
+    m_head_M = static_cast<uint32_t>(irate / g);
+
+    m_length = m_head->sourcePtr()->length();
+    if (m_length != ~0ULL)
+        m_length = (m_length * m_head_L * 2 + m_head_M) / (m_head_M * 2);
+    m_end = m_length;
+    /*
+     * When the length is unknown, an output must not be made before it
+     * is known to be within the end. Reading this many frames ahead of
+     * it proves that it is, or reaches the end first.
+     */
+    m_ahead = m_length == ~0ULL ? m_M / m_L + 2 : 0;
+}
+
+template <typename T>
+size_t PolyphaseResamplerT<T>::readSamples(void *buffer, size_t nsamples)
+{
+    const unsigned nchannels = m_asbd.mChannelsPerFrame;
+    T *fp = static_cast<T*>(buffer);
+    if (nchannels == 1)
+        return readPlanar(&fp, nsamples);
+    for (unsigned c = 0; c < nchannels; ++c) {
+        if (m_output[c].size() < nsamples)
+            m_output[c].resize(nsamples);
+        m_output_planes[c] = &m_output[c][0];
+    }
+    size_t count = readPlanar(&m_output_planes[0], nsamples);
+    util::interleave(&m_output_planes[0], fp, nchannels, count);
+    return count;
+}
+
+template <typename T>
+size_t PolyphaseResamplerT<T>::readPlanar(T * const *channels,
+                                          size_t nsamples)
+{
+    const unsigned ntaps = m_filter->ntaps();
+    size_t count = 0;
+
+    while (count < nsamples && static_cast<uint64_t>(m_position) < m_end) {
+        if (m_index + ntaps + m_ahead > m_frames) {
+            fill(nsamples - count);
+            continue;
+        }
+        if (m_filter->isHalfband()) {
+            count += decimate(channels, count, nsamples - count);
+            continue;
+        }
+        convolve(channels, count);
+        ++count;
+        ++m_position;
+        m_phase += m_M;
+        m_index += m_phase / m_L;
+        m_phase %= m_L;
+    }
+    return count;
+}
+
+template <typename T>
+double PolyphaseResamplerT<T>::latency() const
+{
+    ILatencyReporter *prev =
+        dynamic_cast<ILatencyReporter*>(sourcePtr().get());
+    double input = m_filter->groupDelay() + (prev ? prev->latency() : 0.0);
+    return input * m_L / m_M;
+}
+
+template <typename T>
+bool PolyphaseResamplerT<T>::isSeekable()
+{
+    ISeekableSource *src = dynamic_cast<ISeekableSource*>(source());
+    return src && src->isSeekable();
+}
+
+template <typename T>
+void PolyphaseResamplerT<T>::seekTo(int64_t position)
+{
+    const unsigned nchannels = m_asbd.mChannelsPerFrame;
+
+    /* input frame at the head of the window, may be negative */
+    uint64_t t = static_cast<uint64_t>(position) * m_M;
+    int64_t first = static_cast<int64_t>(t / m_L) - m_filter->delay();
+    m_phase = static_cast<uint32_t>(t % m_L);
+    m_index = 0;
+    m_position = position;
+    m_end = m_length;
+    m_ahead = m_length == ~0ULL ? m_M / m_L + 2 : 0;
+    if (first < 0) {
+        m_frames = static_cast<size_t>(-first);
+        for (unsigned c = 0; c < nchannels; ++c) {
+            if (m_history[c].size() < m_frames)
+                m_history[c].resize(m_frames);
+            std::fill(m_history[c].begin(),
+                      m_history[c].begin() + m_frames, T());
+        }
+        first = 0;
+    } else {
+        m_frames = 0;
+    }
+    seekSource(first);
+    m_consumed = first;
+}
+
+template <typename T>
+void PolyphaseResamplerT<T>::fill(size_t nsamples)
+{
+    const unsigned nchannels = m_asbd.mChannelsPerFrame;
+    const unsigned ntaps = m_filter->ntaps();
+
+    /*
+     * Discard consumed frames. When downsampling, m_index can go beyond
+     * m_frames; the rest is skipped from the next input.
+     */
+    size_t drop = std::min(m_index, m_frames);
+    if (drop > 0) {
+        for (unsigned c = 0; c < nchannels; ++c)
+            std::memmove(&m_history[c][0], &m_history[c][drop],
+                         (m_frames - drop) * sizeof(T));
+        m_frames -= drop;
+        m_index -= drop;
+    }
+    /*
+     * Exactly what the last of nsamples outputs needs (plus m_ahead), so
+     * that nothing more is read ahead of time.
+     */
+    uint64_t last = m_phase + static_cast<uint64_t>(nsamples - 1) * m_M;
+    size_t want = static_cast<size_t>(m_index + last / m_L) + ntaps + m_ahead
+                - m_frames;
+    /* room for the padding at the end of input as well */
+    size_t room = m_frames + std::max<size_t>(want, ntaps);
+    for (unsigned c = 0; c < nchannels; ++c) {
+        if (m_history[c].size() < room)
+            m_history[c].resize(room);
+        m_window[c] = &m_history[c][0];
+        m_planes[c] = &m_history[c][m_frames];
+    }
+    size_t n = readSamplesAsPlanar(source(), &m_pivot, &m_ibuffer,
+                                   &m_planes[0], want);
+    if (n > 0) {
+        m_frames += n;
+        m_consumed += n;
+        return;
+    }
+    /*
+     * End of input: pad with enough silence for the trailing taps, and
+     * stop at the output frame corresponding to the end of input.
+     */
+    for (unsigned c = 0; c < nchannels; ++c)
+        std::fill(m_planes[c], m_planes[c] + ntaps, T());
+    m_frames += ntaps;
+    m_ahead = 0;
+    m_end = (m_head->m_consumed * m_head_L * 2 + m_head_M) / (m_head_M * 2);
+}
+
+/*
+ * Halfband stage (L = 1, M = 2): all the outputs whose window is in the
+ * history at once, up to nsamples. Taps are zero but the center one and
+ * those of the other parity, which are in m_coefs.
+ */
+template <typename T>
+size_t PolyphaseResamplerT<T>::decimate(T * const *channels, size_t offset,
+                                        size_t nsamples)
+{
+    const unsigned nchannels = m_asbd.mChannelsPerFrame;
+    const unsigned ntaps = m_filter->ntaps();
+    const unsigned half = ntaps / 2;
+    const unsigned first = half % 2;
+
+    size_t n = (m_frames - m_ahead - ntaps - m_index) / 2 + 1;
+    n = std::min(n, nsamples);
+    n = static_cast<size_t>(std::min<uint64_t>(n, m_end - m_position));
+    /* center tap at half - 1, from the first of the others */
+    float center = m_filter->phase(0)[half - 1];
+    unsigned cpos = (half - 2 - first) / 2;
+    for (unsigned c = 0; c < nchannels; ++c)
+        decimateHalfband(m_kernel, &m_coefs[0],
+                         static_cast<unsigned>(m_coefs.size()), center, cpos,
+                         m_window[c] + m_index + first, channels[c] + offset,
+                         n);
+    m_position += n;
+    m_index += 2 * n;
+    return n;
+}
+
+/* output frame at offset of each channel, one channel at a time */
+template <typename T>
+void PolyphaseResamplerT<T>::convolve(T * const *channels, size_t offset)
+{
+    const unsigned nchannels = m_asbd.mChannelsPerFrame;
+    const unsigned ntaps = m_filter->ntaps();
+    const float *coefs;
+
+    if (isExact())
+        coefs = m_filter->phase(m_phase);
+    else {
+        double pos =
+            static_cast<double>(m_phase) * m_filter->nphases() / m_L;
+        unsigned n = static_cast<unsigned>(pos);
+        float frac = static_cast<float>(pos - n);
+        coefs = m_filter->phase(n);
+        if (frac > 0.0f) {
+            m_kernel->interpolate(coefs, m_filter->phase(n + 1), frac,
+                                  &m_coefs[0], ntaps);
+            coefs = &m_coefs[0];
+        }
+    }
+    convolvePlanar(m_kernel, coefs, &m_window[0], m_index, ntaps,
+                   nchannels, channels, offset);
+}
+
+template <typename T>
+std::shared_ptr<PolyphaseResamplerT<T> >
+createPolyphaseResampler(const std::shared_ptr<ISource> &src, int rate,
+                         int quality, double bandwidth, bool minphase)
+{
+    double irate = src->getSampleFormat().mSampleRate;
+    uint64_t stage_rate = static_cast<uint64_t>(irate + .5);
+    double attenuation =
+        PolyphaseFilter::attenuation(irate, rate, quality, bandwidth);
+
+    std::shared_ptr<ISource> chain = src;
+    std::shared_ptr<PolyphaseResamplerT<T> > head;
+    while (stage_rate % 2 == 0 && stage_rate / 2 >= 2ULL * rate) {
+        /*
+         * Passband up to the final Nyquist frequency, stopband from where
+         * aliases would fold back into it. Passband ripples of the stages
+         * add up, so they get some margin over the final stage.
+         */
+        double transition = 1.0 - 2.0 * rate / stage_rate;
+        stage_rate /= 2;
+        std::shared_ptr<PolyphaseResamplerT<T> > stage =
+            std::make_shared<PolyphaseResamplerT<T> >(
+                chain, static_cast<int>(stage_rate),
+                filtercache::halfband(attenuation + kStageMargin,
+                                      transition, minphase),
+                head ? head.get() : 0);
+        if (!head)
+            head = stage;
+        chain = stage;
+    }
+    return std::make_shared<PolyphaseResamplerT<T> >(chain, rate, quality,
+                                                     bandwidth, minphase,
+                                                     head.get());
+}
+
+template class PolyphaseResamplerT<float>;
+template class PolyphaseResamplerT<double>;
+
+template std::shared_ptr<PolyphaseResampler>
+createPolyphaseResampler<float>(const std::shared_ptr<ISource> &src,
+                                int rate, int quality, double bandwidth,
+                                bool minphase);
+template std::shared_ptr<PolyphaseResampler64>
+createPolyphaseResampler<double>(const std::shared_ptr<ISource> &src,
+                                 int rate, int quality, double bandwidth,
+                                bool minphase);
@@ -0,0 +1,197 @@
+#ifndef POLYPHASERESAMPLER_H
+#define POLYPHASERESAMPLER_H
+
+#include "iointer.h"
+#include "firkernel.h"
+
+/*
+ * Kaiser windowed sinc lowpass, sampled at nphases() sub-sample offsets.
+ * Parameters follow those of the Windows resampler DMO:
+ *   quality:   half filter length (1-60), in zero crossings of the sinc
+ *              at the lower of the two rates
+ *   bandwidth: cutoff frequency, relative to the lower Nyquist frequency
+ *
+ * phase(n)[k] is the coefficient for k-th input sample of the window, when
+ * the output is located at n/nphases() samples after the tap delay().
+ * There are nphases() + 1 rows, so that phase(n + 1) is always valid.
+ *
+ * With minphase, the linear phase prototype is converted to the minimum
+ * phase one of the same magnitude response: no pre-ringing, and most of
+ * the response is within a few samples of the newest input. The output
+ * is then located at the last tap, and is late by groupDelay().
+ *
+ * With wide (when downsampling), the transition band ends where aliases
+ * would fold back into the passband instead of at the output Nyquist
+ * frequency. It is twice as wide, so the filter is half as long for the
+ * same attenuation, and aliases stay within the transition band.
+ *
+ * halfband() makes the single phase filter of a decimate-by-2 stage,
+ * whose cutoff is at the half of input Nyquist frequency. Unless it is
+ * minimum phase, every other tap of it is zero but the center one, and
+ * isHalfband() tells so.
+ */
+class PolyphaseFilter {
+    unsigned m_nphases;
+    unsigned m_ntaps;
+    bool m_minphase;
+    bool m_halfband;
+    double m_group_delay;
+    const float *m_coefs;
+    std::shared_ptr<const void> m_storage;
+public:
+    PolyphaseFilter(double in_rate, double out_rate, int quality,
+                    double bandwidth, unsigned nphases=256,
+                    bool minphase=false, bool wide=false);
+    /* wrap already designed coefficients, kept alive by storage */
+    PolyphaseFilter(unsigned nphases, unsigned ntaps, const float *coefs,
+                    const std::shared_ptr<const void> &storage,
+                    bool minphase=false, bool halfband=false)
+        : m_nphases(nphases), m_ntaps(ntaps), m_minphase(minphase),
+          m_halfband(halfband), m_coefs(coefs), m_storage(storage)
+    {
+        measure();
+    }
+    unsigned nphases() const { return m_nphases; }
+    unsigned ntaps() const { return m_ntaps; }
+    bool minphase() const { return m_minphase; }
+    bool isHalfband() const { return m_halfband; }
+    /* number of input samples before the tap the output is located at */
+    unsigned delay() const
+    {
+        return m_minphase ? m_ntaps - 1 : m_ntaps / 2 - 1;
+    }
+    /*
+     * Group delay at DC, in input samples from the newest one of the
+     * window: the algorithmic delay when input is fed as it arrives.
+     */
+    double groupDelay() const { return m_group_delay; }
+    const float *phase(unsigned n) const { return m_coefs + n * m_ntaps; }
+    const float *data() const { return m_coefs; }
+    size_t size() const { return (m_nphases + 1) * m_ntaps; }
+
+    /* stopband attenuation in dB implied by the parameters */
+    static double attenuation(double in_rate, double out_rate, int quality,
+                              double bandwidth);
+    /* transition is the width normalized to the input Nyquist frequency */
+    static std::shared_ptr<const PolyphaseFilter>
+        halfband(double attenuation, double transition,
+                 bool minphase=false);
+private:
+    PolyphaseFilter(unsigned nphases, bool minphase)
+        : m_nphases(nphases), m_ntaps(0), m_minphase(minphase),
+          m_halfband(false), m_group_delay(0.0), m_coefs(0)
+    {}
+    void design(unsigned half, double cutoff, double attenuation);
+    void measure();
+};
+
+/*
+ * Portable replacement of DMODSPProcessor + MSResampler.
+ * Converts anything readable by readSamplesAsFloat() into 32bit float
+ * (T = float) or 64bit float (T = double) at the given rate. Output is
+ * aligned to the input (filter delay is compensated), and length() frames
+ * are produced in total.
+ *
+ * The rate ratio is reduced to L/M, and output time is tracked exactly
+ * as an integer index plus m_phase / L. When L is small enough, the
+ * filter has exactly L phases and no coefficient interpolation is done.
+ *
+ * A resampler can also be one stage of a cascade built by
+ * createPolyphaseResampler(). In that case, head is the first stage, and
+ * the length and the end of stream are computed from its input, so that
+ * rounding doesn't accumulate over the stages.
+ *
+ * When the source is seekable, so is the resampler. seekTo() restarts
+ * from the input frames under the filter window of the given output
+ * frame, and gives exactly the same samples as reading up to there.
+ *
+ * Processing is planar: the history holds each channel contiguously, and
+ * is filled by readPlanar() of the source when it has one (as the other
+ * stages of a cascade do). readSamples() interleaves at the end.
+ *
+ * The double version keeps the history and the sums in double, so that
+ * stages don't add rounding error of float; coefficients are the same
+ * float tables (their rounding only changes the filter response, by far
+ * less than the stopband).
+ */
+template <typename T>
+class PolyphaseResamplerT: public FilterBase, public IPlanarSource<T>,
+    public ILatencyReporter
+{
+    AudioStreamBasicDescription m_asbd;
+    std::shared_ptr<const PolyphaseFilter> m_filter;
+    const firkernel::Kernel *m_kernel;
+    uint64_t m_length;
+    int64_t m_position;
+    uint64_t m_end;
+    uint64_t m_consumed;
+    const PolyphaseResamplerT *m_head;
+    uint32_t m_head_L;
+    uint32_t m_head_M;
+    uint32_t m_L;
+    uint32_t m_M;
+    uint32_t m_phase;
+    size_t m_index;
+    size_t m_frames;
+    /* frames read past what the outputs need, until the end is seen */
+    size_t m_ahead;
+    std::vector<std::vector<T> > m_history;
+    std::vector<std::vector<T> > m_output;
+    std::vector<T*> m_output_planes;
+    std::vector<T*> m_planes;
+    /* heads of m_history, set by fill() which runs before convolve() */
+    std::vector<const T*> m_window;
+    std::vector<float> m_coefs;
+    std::vector<T> m_ibuffer;
+    util::AlignedBuffer m_pivot;
+public:
+    PolyphaseResamplerT(const std::shared_ptr<ISource> &src, int rate,
+                        int quality=60, double bandwidth=0.95,
+                        bool minphase=false,
+                        const PolyphaseResamplerT *head=0);
+    PolyphaseResamplerT(const std::shared_ptr<ISource> &src, int rate,
+                        const std::shared_ptr<const PolyphaseFilter> &filter,
+                        const PolyphaseResamplerT *head);
+    uint64_t length() const { return m_length; }
+    const AudioStreamBasicDescription &getSampleFormat() const
+    {
+        return m_asbd;
+    }
+    int64_t getPosition() { return m_position; }
+    size_t readSamples(void *buffer, size_t nsamples);
+    size_t readPlanar(T * const *channels, size_t nsamples);
+    bool isSeekable();
+    void seekTo(int64_t position);
+    /* including the stages before this one */
+    double latency() const;
+private:
+    void init(int rate);
+    bool isExact() const { return m_filter->nphases() == m_L; }
+    void fill(size_t nsamples);
+    size_t decimate(T * const *channels, size_t offset, size_t nsamples);
+    void convolve(T * const *channels, size_t offset);
+};
+
+typedef PolyphaseResamplerT<float> PolyphaseResampler;
+typedef PolyphaseResamplerT<double> PolyphaseResampler64;
+
+/*
+ * Plans the conversion. When downsampling by 4 or more, the rate is
+ * first halved by halfband stages as long as the result stays at least
+ * twice the target, then a final PolyphaseResampler does the rest.
+ * Halfband stages keep the whole band below the final Nyquist frequency,
+ * and a stopband attenuation slightly higher than the final stage.
+ * They compute output samples only and skip the zero taps, and the final
+ * stage gets the wide transition (aliasing stays in the transition band).
+ * Measured at q60 with AVX2: 384k->44.1k takes 226 MACs per output frame
+ * against 1046 for one stage, and runs 2.5x faster; 768k->44.1k 3.3x.
+ * T is float or double, and is given explicitly.
+ * With minphase, every stage uses minimum phase filters.
+ */
+template <typename T>
+std::shared_ptr<PolyphaseResamplerT<T> >
+    createPolyphaseResampler(const std::shared_ptr<ISource> &src, int rate,
+                             int quality=60, double bandwidth=0.95,
+                             bool minphase=false);
+
+#endif
@@ -1,3 +1,5 @@
+#include <climits>
+#include <cmath>
 #include "Quantizer.h"
 
 template <typename T>
@@ -8,62 +10,77 @@ inline T clip(T x, T min, T max)
     return x;
 }
 
-/* inacculate, but much faster than std::uniform_int_distribution<> */
-template <typename Engine>
-class RandomIntSpan {
-    Engine &e_;
-    int div_, off_;
-public:
-    RandomIntSpan(Engine &e, int min, int max)
-        : e_(e), off_(min)
-    {
-        div_ = e.max() / (max - min);
-    }
-    int operator()() { return e_() / div_ + off_; }
-};
-
 Quantizer::Quantizer(const std::shared_ptr<ISource> &source,
-                     uint32_t bitdepth, bool no_dither, bool is_float)
-    : FilterBase(source), m_no_dither(no_dither)
+                     uint32_t bitdepth, bool no_dither, bool is_float,
+                     uint32_t seed, NoiseShaper::Type shaping)
+    : FilterBase(source),
+      m_seed(seed),
+      m_kernel(&ditherkernel::get()),
+      m_no_dither(no_dither)
 {
     const AudioStreamBasicDescription &asbd = source->getSampleFormat();
     m_asbd = cautil::buildASBDForPCM2(asbd.mSampleRate,
                                       asbd.mChannelsPerFrame,
-                                      bitdepth, 32,
+                                      bitdepth, bitdepth == 64 ? 64 : 32,
                                       is_float ? kAudioFormatFlagIsFloat
                                         : kAudioFormatFlagIsSignedInteger);
+    if (shaping != NoiseShaper::kNone)
+        m_shaper = std::make_shared<NoiseShaper>(shaping, asbd.mSampleRate,
+                                                 asbd.mChannelsPerFrame);
 }
 
 size_t Quantizer::readSamples(void *buffer, size_t nsamples)
 {
     const AudioStreamBasicDescription &iasbd = source()->getSampleFormat();
+    unsigned depth = m_asbd.mBitsPerChannel;
+    int64_t position = source()->getPosition();
+    int *ip = static_cast<int*>(buffer);
 
-    if (m_asbd.mFormatFlags & kAudioFormatFlagIsFloat) {
+    if ((m_asbd.mFormatFlags & kAudioFormatFlagIsFloat) && depth == 64) {
+        double *dp = static_cast<double*>(buffer);
+        nsamples = readSamplesAsFloat(source(), &m_ibuffer, dp, nsamples);
+    } else if (m_asbd.mFormatFlags & kAudioFormatFlagIsFloat) {
         float *fp = static_cast<float*>(buffer);
         nsamples = readSamplesAsFloat(source(), &m_ibuffer, fp, nsamples);
     } else if (iasbd.mFormatFlags & kAudioFormatFlagIsSignedInteger) {
         nsamples = source()->readSamples(buffer, nsamples);
         if (m_asbd.mBitsPerChannel < iasbd.mBitsPerChannel) {
-            ditherInt(static_cast<int*>(buffer),
-                      nsamples * m_asbd.mChannelsPerFrame,
-                      m_asbd.mBitsPerChannel);
+            bool dither = depth <= 18 && !m_no_dither;
+            ditherInt(ip, nsamples * m_asbd.mChannelsPerFrame, depth,
+                      generateNoise(position, nsamples, dither));
         }
     } else if (iasbd.mBitsPerChannel <= 32) {
+        bool dither = !m_no_dither && (depth <= 18 || m_shaper);
         nsamples = readSamplesAsFloat(source(), 0, &m_fbuffer,
                                       nsamples);
-        ditherFloat(&m_fbuffer[0], static_cast<int*>(buffer),
-                    nsamples * m_asbd.mChannelsPerFrame,
-                    m_asbd.mBitsPerChannel);
+        const double *noise = generateNoise(position, nsamples, dither);
+        if (m_shaper)
+            m_shaper->process(&m_fbuffer[0], noise, ip, nsamples, depth);
+        else
+            m_kernel->quantizeFloat(&m_fbuffer[0], noise, ip,
+                                    nsamples * m_asbd.mChannelsPerFrame,
+                                    depth);
     } else {
+        bool dither = !m_no_dither && (depth <= 18 || m_shaper);
         nsamples = readSamplesAsFloat(source(), 0, &m_dbuffer,
                                       nsamples);
-        ditherFloat(&m_dbuffer[0], static_cast<int*>(buffer),
-                    nsamples * m_asbd.mChannelsPerFrame,
-                    m_asbd.mBitsPerChannel);
+        const double *noise = generateNoise(position, nsamples, dither);
+        if (m_shaper)
+            m_shaper->process(&m_dbuffer[0], noise, ip, nsamples, depth);
+        else
+            m_kernel->quantizeDouble(&m_dbuffer[0], noise, ip,
+                                     nsamples * m_asbd.mChannelsPerFrame,
+                                     depth);
     }
     return nsamples;
 }
 
+bool Quantizer::isSeekable()
+{
+    ISeekableSource *src = dynamic_cast<ISeekableSource*>(source());
+    return !m_shaper && src && src->isSeekable();
+}
+
 /*
  *  MSB <-------------------------> LSB
  *  <----------- original ------------>
@@ -73,44 +90,38 @@ size_t Quantizer::readSamples(void *buffer, size_t nsamples)
  *  We regard this as 24.7 fixed point num, and round to 24bit int.
  *  (We truncate 1bit from LSB side for handling overflow/saturation)
  */
-void Quantizer::ditherInt(int *data, size_t count, unsigned depth)
+void Quantizer::ditherInt(int *data, size_t count, unsigned depth,
+                          const double *noise)
 {
     const int one = 1 << (31 - depth);
     const int half = one / 2;
     const unsigned mask = ~(one - 1);
-    /*
-     * XXX:
-     * std::uniform_int_distribution<int> is too slow due to
-     * double<->int conversion
-     */
-    // std::uniform_int_distribution<int> dist(-half, half);
-    RandomIntSpan<std::mt19937> nrand(m_mt, -half, half);
     for (size_t i = 0; i < count; ++i) {
         int value = data[i] >> 1;
-        if (depth <= 18 && !m_no_dither) {
-            // int noise = dist(m_mt) + dist(m_mt);
-            int noise = nrand() + nrand();
-            value += noise;
-        }
+        if (noise)
+            value += static_cast<int>(lrint(noise[i] * one));
         data[i] = (clip(value + half, INT_MIN >> 1, INT_MAX >> 1) & mask)<< 1;
     }
 }
 
-template <typename T>
-void Quantizer::ditherFloat(T *src, int *dst, size_t count, unsigned depth)
+/*
+ * Noise for nsamples frames from position. Null without dither, except
+ * for the noise shaper which always takes noise (zero then).
+ */
+const double *Quantizer::generateNoise(int64_t position, size_t nsamples,
+                                       bool dither)
 {
-    int shifts = 32 - depth;
-    double half = 1U << (depth - 1);
-    double min_value = -half;
-    double max_value = half - 1;
-    std::uniform_real_distribution<double> dist(-0.5, 0.5);
-    for (size_t i = 0; i < count; ++i) {
-        double value = src[i] * half;
-        if (depth <= 18 && !m_no_dither) {
-            double noise = dist(m_mt) + dist(m_mt);
-            value += noise;
-        }
-        dst[i] = lrint(clip(value, min_value, max_value)) << shifts;
-    }
+    size_t count = nsamples * m_asbd.mChannelsPerFrame;
+    if (!dither && !m_shaper)
+        return 0;
+    if (!count)
+        return 0;
+    if (m_noise.size() < count)
+        m_noise.resize(count);
+    if (dither)
+        m_kernel->noise(m_seed, position * m_asbd.mChannelsPerFrame,
+                        &m_noise[0], count);
+    else
+        std::fill(m_noise.begin(), m_noise.begin() + count, 0.0);
+    return &m_noise[0];
 }
-
@@ -2,29 +2,48 @@
 #define INTEGER_SOURCE_H
 
 #include <assert.h>
-#include <random>
 #include "iointer.h"
 #include "cautil.h"
+#include "ditherkernel.h"
+#include "NoiseShaper.h"
 
+/*
+ * Quantizes to bitdepth, with TPDF dither up to 18 bits unless no_dither.
+ * Dither noise is a function of seed and the position of the sample in
+ * the stream (see ditherkernel), so that the output doesn't depend on how
+ * it is read, and seeking gives the same samples as reading up to there.
+ * With shaping, float input is dithered at any bitdepth (unless no_dither)
+ * and the error is shaped by NoiseShaper. That has state, so it is not
+ * seekable then.
+ * With is_float, samples are only converted: to 32bit float, or to 64bit
+ * float when bitdepth is 64.
+ */
 class Quantizer: public FilterBase {
     AudioStreamBasicDescription m_asbd;
-    std::mt19937 m_mt;
-    std::vector<uint8_t> m_ibuffer;
+    uint32_t m_seed;
+    const ditherkernel::Kernel *m_kernel;
+    util::AlignedBuffer m_ibuffer;
     std::vector<float> m_fbuffer;
     std::vector<double> m_dbuffer;
+    std::vector<double> m_noise;
+    std::shared_ptr<NoiseShaper> m_shaper;
     bool m_no_dither;
 public:
     Quantizer(const std::shared_ptr<ISource> &source, uint32_t bitdepth,
-              bool no_dither, bool is_float=false);
+              bool no_dither, bool is_float=false, uint32_t seed=0,
+              NoiseShaper::Type shaping=NoiseShaper::kNone);
     const AudioStreamBasicDescription &getSampleFormat() const
     {
         return m_asbd;
     }
     size_t readSamples(void *buffer, size_t nsamples);
+    bool isSeekable();
+    void seekTo(int64_t position) { seekSource(position); }
 private:
-    void ditherInt(int *data, size_t count, unsigned depth);
-    template <typename T>
-    void ditherFloat(T *src, int *dst, size_t count, unsigned depth);
+    void ditherInt(int *data, size_t count, unsigned depth,
+                   const double *noise);
+    const double *generateNoise(int64_t position, size_t nsamples,
+                                bool dither);
 };
 
 #endif
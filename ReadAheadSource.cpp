@@ -0,0 +1,126 @@
+#include "ReadAheadSource.h"
+
+ReadAheadSource::ReadAheadSource(const std::shared_ptr<ISource> &src,
+                                 unsigned depth, size_t block_frames)
+    : FilterBase(src),
+      m_block_frames(block_frames),
+      m_head(0),
+      m_offset(0),
+      m_filled(0),
+      m_position(src->getPosition()),
+      m_eof(false),
+      m_quit(false),
+      m_consumer_stalls(0),
+      m_producer_stalls(0)
+{
+    const AudioStreamBasicDescription &asbd = src->getSampleFormat();
+    m_blocks.resize(std::max(depth, 1U));
+    for (size_t i = 0; i < m_blocks.size(); ++i) {
+        m_blocks[i].data.resize(block_frames * asbd.mBytesPerFrame);
+        m_blocks[i].count = 0;
+    }
+    m_thread = std::thread(&ReadAheadSource::run, this);
+}
+
+ReadAheadSource::~ReadAheadSource()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_quit = true;
+    }
+    m_cond.notify_all();
+    m_thread.join();
+}
+
+size_t ReadAheadSource::readSamples(void *buffer, size_t nsamples)
+{
+    const unsigned bpf = getSampleFormat().mBytesPerFrame;
+    uint8_t *bp = static_cast<uint8_t*>(buffer);
+    size_t count = 0;
+
+    while (count < nsamples) {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            if (!m_filled && !m_eof) {
+                ++m_consumer_stalls;
+                do
+                    m_cond.wait(lock);
+                while (!m_filled && !m_eof);
+            }
+            if (!m_filled) {
+                if (m_error && !count)
+                    std::rethrow_exception(m_error);
+                break;
+            }
+        }
+        /* the head block is ours until released */
+        Block &block = m_blocks[m_head];
+        size_t n = std::min(nsamples - count, block.count - m_offset);
+        std::memcpy(bp + count * bpf, &block.data[m_offset * bpf], n * bpf);
+        count += n;
+        m_offset += n;
+        if (m_offset == block.count) {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_head = (m_head + 1) % m_blocks.size();
+                --m_filled;
+                m_offset = 0;
+            }
+            m_cond.notify_all();
+        }
+    }
+    m_position += count;
+    return count;
+}
+
+uint64_t ReadAheadSource::consumerStalls()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_consumer_stalls;
+}
+
+uint64_t ReadAheadSource::producerStalls()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_producer_stalls;
+}
+
+void ReadAheadSource::run()
+{
+    for (;;) {
+        size_t tail;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            if (m_filled == m_blocks.size() && !m_quit) {
+                ++m_producer_stalls;
+                do
+                    m_cond.wait(lock);
+                while (m_filled == m_blocks.size() && !m_quit);
+            }
+            if (m_quit)
+                return;
+            tail = (m_head + m_filled) % m_blocks.size();
+        }
+        Block &block = m_blocks[tail];
+        size_t n = 0;
+        std::exception_ptr error;
+        try {
+            n = source()->readSamples(&block.data[0], m_block_frames);
+        } catch (...) {
+            error = std::current_exception();
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (n) {
+                block.count = n;
+                ++m_filled;
+            } else {
+                m_error = error;
+                m_eof = true;
+            }
+        }
+        m_cond.notify_all();
+        if (!n)
+            return;
+    }
+}
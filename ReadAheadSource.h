@@ -0,0 +1,52 @@
+#ifndef READAHEADSOURCE_H
+#define READAHEADSOURCE_H
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include "iointer.h"
+
+/*
+ * Reads the source ahead on a background thread, into a ring of depth
+ * blocks of block_frames each, allocated up front.
+ * An exception thrown by the source is rethrown by readSamples() once the
+ * blocks read before it are consumed.
+ *
+ * consumerStalls() counts how many times readSamples() had to wait for
+ * the reader (input is the bottleneck), producerStalls() how many times
+ * the reader found the ring full (processing is the bottleneck).
+ */
+class ReadAheadSource: public FilterBase {
+    struct Block {
+        std::vector<uint8_t> data;
+        size_t count;
+    };
+    std::vector<Block> m_blocks;
+    size_t m_block_frames;
+    size_t m_head;
+    size_t m_offset;
+    size_t m_filled;
+    int64_t m_position;
+    bool m_eof;
+    bool m_quit;
+    std::exception_ptr m_error;
+    uint64_t m_consumer_stalls;
+    uint64_t m_producer_stalls;
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    std::thread m_thread;
+public:
+    ReadAheadSource(const std::shared_ptr<ISource> &src, unsigned depth=4,
+                    size_t block_frames=4096);
+    ~ReadAheadSource();
+    int64_t getPosition() { return m_position; }
+    size_t readSamples(void *buffer, size_t nsamples);
+
+    uint64_t consumerStalls();
+    uint64_t producerStalls();
+private:
+    void run();
+};
+
+#endif
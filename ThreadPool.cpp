@@ -0,0 +1,69 @@
+#include "ThreadPool.h"
+
+ThreadPool::ThreadPool(unsigned nthreads)
+    : m_quit(false)
+{
+    if (nthreads < 1)
+        nthreads = 1;
+    for (unsigned i = 0; i < nthreads; ++i)
+        m_threads.push_back(std::thread(&ThreadPool::worker, this));
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_quit = true;
+    }
+    m_cond.notify_all();
+    for (size_t i = 0; i < m_threads.size(); ++i)
+        m_threads[i].join();
+}
+
+std::future<void> ThreadPool::submit(const std::function<void()> &task)
+{
+    std::shared_ptr<std::packaged_task<void()> >
+        job(std::make_shared<std::packaged_task<void()> >(task));
+    std::future<void> result = job->get_future();
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_queue.push_back([job]() { (*job)(); });
+    }
+    m_cond.notify_one();
+    return result;
+}
+
+void ThreadPool::run(size_t n, const std::function<void(size_t)> &fn)
+{
+    std::vector<std::future<void> > results;
+    for (size_t i = 0; i < n; ++i)
+        results.push_back(submit(std::bind(fn, i)));
+    /* wait for everything before rethrowing, fn may refer to our stack */
+    for (size_t i = 0; i < n; ++i)
+        results[i].wait();
+    for (size_t i = 0; i < n; ++i)
+        results[i].get();
+}
+
+unsigned ThreadPool::defaultSize()
+{
+    unsigned n = std::thread::hardware_concurrency();
+    return n ? n : 1;
+}
+
+void ThreadPool::worker()
+{
+    for (;;) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            while (!m_quit && m_queue.empty())
+                m_cond.wait(lock);
+            if (m_queue.empty())
+                return;
+            task.swap(m_queue.front());
+            m_queue.pop_front();
+        }
+        task();
+    }
+}
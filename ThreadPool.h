@@ -0,0 +1,45 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <deque>
+#include <vector>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+/*
+ * Fixed number of worker threads, started in the constructor and joined
+ * in the destructor. Tasks are run in the order of submission.
+ */
+class ThreadPool {
+    std::vector<std::thread> m_threads;
+    std::deque<std::function<void()> > m_queue;
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    bool m_quit;
+public:
+    explicit ThreadPool(unsigned nthreads);
+    ~ThreadPool();
+    unsigned size() const { return static_cast<unsigned>(m_threads.size()); }
+
+    /* exception thrown by the task is rethrown by get() of the future */
+    std::future<void> submit(const std::function<void()> &task);
+
+    /*
+     * Calls fn(0) ... fn(n - 1) on the pool and waits for all of them.
+     * The first exception (in index order) is rethrown.
+     * Must not be called from a worker of the same pool.
+     */
+    void run(size_t n, const std::function<void(size_t)> &fn);
+
+    /* number of hardware threads, at least 1 */
+    static unsigned defaultSize();
+private:
+    void worker();
+    ThreadPool(const ThreadPool&);
+    ThreadPool &operator=(const ThreadPool&);
+};
+
+#endif
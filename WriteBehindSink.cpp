@@ -0,0 +1,106 @@
+#include "WriteBehindSink.h"
+
+WriteBehindSink::WriteBehindSink(const std::shared_ptr<ISink> &sink,
+                                 unsigned depth)
+    : m_sink(sink),
+      m_quit(false),
+      m_stalls(0)
+{
+    m_blocks.resize(std::max(depth, 1U));
+    for (size_t i = 0; i < m_blocks.size(); ++i)
+        m_free.push_back(&m_blocks[i]);
+    m_thread = std::thread(&WriteBehindSink::run, this);
+}
+
+WriteBehindSink::~WriteBehindSink()
+{
+    try {
+        finish();
+    } catch (...) {}
+}
+
+void WriteBehindSink::writeSamples(const void *data, size_t length,
+                                   size_t nsamples)
+{
+    Block *block;
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (m_free.empty() && !m_error) {
+            ++m_stalls;
+            do
+                m_cond.wait(lock);
+            while (m_free.empty() && !m_error);
+        }
+        if (m_error)
+            std::rethrow_exception(m_error);
+        block = m_free.front();
+        m_free.pop_front();
+    }
+    /* buffers grow to the largest write, and are reused after that */
+    if (block->data.size() < length)
+        block->data.resize(length);
+    std::memcpy(&block->data[0], data, length);
+    block->length = length;
+    block->nsamples = nsamples;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_queue.push_back(block);
+    }
+    m_cond.notify_all();
+}
+
+void WriteBehindSink::finish()
+{
+    if (m_thread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_quit = true;
+        }
+        m_cond.notify_all();
+        m_thread.join();
+    }
+    if (m_error)
+        std::rethrow_exception(m_error);
+}
+
+uint64_t WriteBehindSink::stalls()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stalls;
+}
+
+void WriteBehindSink::run()
+{
+    for (;;) {
+        Block *block;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            while (m_queue.empty() && !m_quit)
+                m_cond.wait(lock);
+            if (m_queue.empty())
+                return;
+            block = m_queue.front();
+            m_queue.pop_front();
+        }
+        std::exception_ptr error;
+        try {
+            m_sink->writeSamples(&block->data[0], block->length,
+                                 block->nsamples);
+        } catch (...) {
+            error = std::current_exception();
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_free.push_back(block);
+            if (error) {
+                m_error = error;
+                /* discard the rest */
+                while (!m_queue.empty()) {
+                    m_free.push_back(m_queue.front());
+                    m_queue.pop_front();
+                }
+            }
+        }
+        m_cond.notify_all();
+    }
+}
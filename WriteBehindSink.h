@@ -0,0 +1,48 @@
+#ifndef WRITEBEHINDSINK_H
+#define WRITEBEHINDSINK_H
+
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include "iointer.h"
+
+/*
+ * Passes the data to sink on a writer thread.
+ * writeSamples() copies into one of depth reusable buffers and returns;
+ * when all of them are queued, it waits for the writer (backpressure).
+ * An error of the writer is rethrown by the next writeSamples() or
+ * finish(), and further data is discarded.
+ *
+ * finish() waits until everything is written; call it before finishing
+ * the underlying sink.
+ */
+class WriteBehindSink: public ISink {
+    struct Block {
+        std::vector<uint8_t> data;
+        size_t length;
+        size_t nsamples;
+    };
+    std::shared_ptr<ISink> m_sink;
+    std::vector<Block> m_blocks;
+    std::deque<Block*> m_free;
+    std::deque<Block*> m_queue;
+    bool m_quit;
+    std::exception_ptr m_error;
+    uint64_t m_stalls;
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    std::thread m_thread;
+public:
+    WriteBehindSink(const std::shared_ptr<ISink> &sink, unsigned depth=4);
+    ~WriteBehindSink();
+    void writeSamples(const void *data, size_t length, size_t nsamples);
+    void finish();
+    /* number of times writeSamples() waited for a free buffer */
+    uint64_t stalls();
+private:
+    void run();
+};
+
+#endif
@@ -24,7 +24,7 @@ namespace cautil {
         return ss.str();
     }
 
-#ifndef REFALAC
+#if defined(_WIN32) && !defined(REFALAC)
     CFMutableDictionaryRef CreateDictionary(CFIndex capacity)
     {
         static CFDictionaryKeyCallBacks *keyCB;
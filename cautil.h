@@ -65,7 +65,9 @@ namespace cautil {
         return CFStringPtr(sref, CFRelease);
     }
 
+#if defined(_WIN32) && !defined(REFALAC)
     CFMutableDictionaryRef CreateDictionary(CFIndex capacity);
+#endif
 
     inline size_t sizeofAudioChannelLayout(const AudioChannelLayout &acl)
     {
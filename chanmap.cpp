@@ -1,4 +1,7 @@
 #include "chanmap.h"
+#include "shufflekernel.h"
+#include "cpuinfo.h"
+#include "cautil.h"
 
 namespace chanmap {
 
@@ -347,12 +350,102 @@ void getMappingToAAC(uint32_t bitmap, std::vector<uint32_t> *result)
     result->swap(mapping);
 }
 
+/*
+ * Where a channel goes when the output doesn't have it, in order of
+ * preference. The first route whose targets are all in the output is taken,
+ * otherwise the last one is followed further.
+ */
+struct DownmixRoute {
+    uint32_t from;
+    uint32_t to[2];
+    double gain;
+};
+
+const double k3dB = 0.70710678118654752;
+
+const DownmixRoute downmixRoutes[] = {
+    { 1,  { 3, 0 },   k3dB }, // L -> C
+    { 2,  { 3, 0 },   k3dB }, // R -> C
+    { 3,  { 1, 2 },   k3dB }, // C -> L R
+    { 5,  { 10, 0 },  1.0  }, // Ls -> Lsd
+    { 5,  { 1, 0 },   k3dB }, // Ls -> L
+    { 6,  { 11, 0 },  1.0  }, // Rs -> Rsd
+    { 6,  { 2, 0 },   k3dB }, // Rs -> R
+    { 7,  { 1, 0 },   1.0  }, // Lc -> L
+    { 8,  { 2, 0 },   1.0  }, // Rc -> R
+    { 9,  { 5, 6 },   k3dB }, // Cs -> Ls Rs
+    { 9,  { 10, 11 }, k3dB }, // Cs -> Lsd Rsd
+    { 9,  { 1, 2 },   0.5  }, // Cs -> L R
+    { 10, { 5, 0 },   1.0  }, // Lsd -> Ls
+    { 10, { 1, 0 },   k3dB }, // Lsd -> L
+    { 11, { 6, 0 },   1.0  }, // Rsd -> Rs
+    { 11, { 2, 0 },   k3dB }, // Rsd -> R
+    { 12, { 3, 0 },   k3dB }, // Ts -> C
+    { 13, { 1, 0 },   k3dB }, // Vhl -> L
+    { 14, { 3, 0 },   k3dB }, // Vhc -> C
+    { 15, { 2, 0 },   k3dB }, // Vhr -> R
+    { 16, { 5, 0 },   k3dB }, // Tbl -> Ls
+    { 17, { 9, 0 },   k3dB }, // Tbc -> Cs
+    { 18, { 6, 0 },   k3dB }, // Tbr -> Rs
+};
+
+bool hasChannel(uint32_t bitmap, uint32_t channel)
+{
+    return channel && channel <= 32 && (bitmap & (1U << (channel - 1)));
+}
+
+void addDownmixGain(uint32_t channel, double gain, uint32_t bitmap,
+                    unsigned depth, std::map<uint32_t, double> *gains)
+{
+    if (hasChannel(bitmap, channel)) {
+        (*gains)[channel] += gain;
+        return;
+    }
+    if (channel == 4) // LFE
+        return;
+    const DownmixRoute *route = 0;
+    size_t n = sizeof(downmixRoutes) / sizeof(downmixRoutes[0]);
+    for (size_t i = 0; i < n; ++i) {
+        const DownmixRoute &r = downmixRoutes[i];
+        if (r.from != channel)
+            continue;
+        route = &r;
+        if (hasChannel(bitmap, r.to[0]) &&
+            (!r.to[1] || hasChannel(bitmap, r.to[1])))
+            break;
+    }
+    if (!route || depth > 4)
+        throw std::runtime_error(strutil::format(
+                "No downmix defined for channel %s",
+                GetChannelName(channel)));
+    for (unsigned i = 0; i < 2 && route->to[i]; ++i)
+        addDownmixGain(route->to[i], gain * route->gain, bitmap, depth + 1,
+                       gains);
+}
+
+void getDownmixMatrix(const std::vector<uint32_t> &channels,
+                      uint32_t bitmap,
+                      std::vector<std::vector<double> > *result)
+{
+    std::vector<uint32_t> ochannels;
+    getChannels(bitmap, &ochannels);
+    std::vector<std::vector<double> >
+        matrix(ochannels.size(), std::vector<double>(channels.size()));
+    for (size_t i = 0; i < channels.size(); ++i) {
+        std::map<uint32_t, double> gains;
+        addDownmixGain(channels[i], 1.0, bitmap, 0, &gains);
+        for (size_t o = 0; o < ochannels.size(); ++o)
+            matrix[o][i] = gains[ochannels[o]];
+    }
+    result->swap(matrix);
+}
+
 } // namespace
 
 ChannelMapper::ChannelMapper(const std::shared_ptr<ISource> &source,
                              const std::vector<uint32_t> &chanmap,
                              uint32_t bitmap)
-    : FilterBase(source)
+    : FilterBase(source), m_group(0), m_avx2(false)
 {
     for (size_t i = 0; i < chanmap.size(); ++i)
         m_chanmap.push_back(chanmap[i] - 1);
@@ -366,22 +459,106 @@ ChannelMapper::ChannelMapper(const std::shared_ptr<ISource> &source,
             for (size_t i = 0; i < m_chanmap.size(); ++i)
                 m_layout.push_back(orig->at(m_chanmap[i]));
     }
+    const AudioStreamBasicDescription &asbd = source->getSampleFormat();
+    unsigned framelen = asbd.mBytesPerFrame;
+    unsigned nchannels = asbd.mChannelsPerFrame;
+    unsigned width = framelen / nchannels;
+    m_frame.resize(framelen);
+
+    /* bytes past the mapped channels (and past the frames) stay put */
+    if (width == 4 && nchannels <= 8 && cpuinfo::avx2()) {
+        m_avx2 = true;
+        m_group = 8 / nchannels;
+        for (unsigned i = 0; i < 8; ++i) {
+            unsigned f = i / nchannels, c = i % nchannels;
+            m_index[i] = (f < m_group && c < m_chanmap.size())
+                ? f * nchannels + m_chanmap[c] : i;
+        }
+    } else if (framelen <= 16 && cpuinfo::ssse3()) {
+        m_group = 16 / framelen;
+        for (unsigned i = 0; i < 16; ++i) {
+            unsigned f = i / framelen, c = i % framelen / width;
+            m_mask[i] = (f < m_group && c < m_chanmap.size())
+                ? f * framelen + m_chanmap[c] * width + i % width : i;
+        }
+    }
 }
 
 size_t ChannelMapper::readSamples(void *buffer, size_t nsamples)
 {
-    const AudioStreamBasicDescription &asbd = source()->getSampleFormat();
-    size_t framelen = asbd.mBytesPerFrame;
-    size_t width = framelen / asbd.mChannelsPerFrame;
-    std::vector<char> tmp_buffer(framelen);
+    size_t framelen = m_frame.size();
+    size_t width = framelen / source()->getSampleFormat().mChannelsPerFrame;
     size_t rc = source()->readSamples(buffer, nsamples);
     char *bp = reinterpret_cast<char*>(buffer);
-    for (size_t i = 0; i < rc ; ++i, bp += framelen) {
-        std::memcpy(&tmp_buffer[0], bp, framelen);
+    size_t i = 0;
+    if (m_group) {
+        size_t window = m_avx2 ? 32 : 16;
+        size_t stride = framelen * m_group;
+        if (rc * framelen >= window) {
+            size_t count = (rc * framelen - window) / stride + 1;
+            if (m_avx2)
+                shufflekernel::permuteDwords_avx2(m_index, bp, stride, count);
+            else
+                shufflekernel::shuffleBytes_ssse3(m_mask, bp, stride, count);
+            i = count * m_group;
+            bp += count * stride;
+        }
+    }
+    for (; i < rc ; ++i, bp += framelen) {
+        std::memcpy(&m_frame[0], bp, framelen);
         for (size_t j = 0; j < m_chanmap.size(); ++j) {
             std::memcpy(bp + width * j,
-                    &tmp_buffer[0] + width * m_chanmap[j], width);
+                    &m_frame[0] + width * m_chanmap[j], width);
         }
     }
     return rc;
 }
+
+ChannelMixer::ChannelMixer(const std::shared_ptr<ISource> &source,
+                           const std::vector<std::vector<double> > &matrix,
+                           uint32_t bitmap)
+    : FilterBase(source), m_kernel(&mixkernel::get())
+{
+    const AudioStreamBasicDescription &asbd = source->getSampleFormat();
+    unsigned nin = asbd.mChannelsPerFrame;
+    unsigned nout = matrix.size();
+    if (!nout)
+        throw std::runtime_error("ChannelMixer: empty matrix");
+    for (unsigned o = 0; o < nout; ++o)
+        if (matrix[o].size() != nin)
+            throw std::runtime_error(strutil::format(
+                "ChannelMixer: %u coefficients given for %u channels",
+                static_cast<uint32_t>(matrix[o].size()), nin));
+    if (bitmap) {
+        chanmap::getChannels(bitmap, &m_layout);
+        if (m_layout.size() != nout)
+            throw std::runtime_error("ChannelMixer: channel layout doesn't "
+                                     "match the matrix");
+    }
+    m_asbd = cautil::buildASBDForPCM(asbd.mSampleRate, nout, 32,
+                                     kAudioFormatFlagIsFloat);
+
+    /* columns in chunks of 8 outputs, see mixkernel.h */
+    m_coefs.resize((nout + 7) / 8 * 8 * nin);
+    for (unsigned o = 0; o < nout; ++o)
+        for (unsigned i = 0; i < nin; ++i)
+            m_coefs[(o / 8 * nin + i) * 8 + o % 8] =
+                static_cast<float>(matrix[o][i]);
+}
+
+size_t ChannelMixer::readSamples(void *buffer, size_t nsamples)
+{
+    const AudioStreamBasicDescription &asbd = source()->getSampleFormat();
+    nsamples = readSamplesAsFloat(source(), &m_pivot, &m_ibuffer, nsamples);
+    if (nsamples)
+        m_kernel->mix(&m_ibuffer[0], static_cast<float*>(buffer), nsamples,
+                      &m_coefs[0], asbd.mChannelsPerFrame,
+                      m_asbd.mChannelsPerFrame);
+    return nsamples;
+}
+
+bool ChannelMixer::isSeekable()
+{
+    ISeekableSource *src = dynamic_cast<ISeekableSource*>(source());
+    return src && src->isSeekable();
+}
@@ -4,6 +4,7 @@
 #include <stdint.h>
 #include "CoreAudio/CoreAudioTypes.h"
 #include "iointer.h"
+#include "mixkernel.h"
 
 namespace chanmap {
     std::string getChannelNames(const std::vector<uint32_t> &channels);
@@ -19,11 +20,32 @@ namespace chanmap {
     uint32_t defaultChannelMask(uint32_t nchannels);
     uint32_t AACLayoutFromBitmap(uint32_t bitmap);
     void getMappingToAAC(uint32_t bitmap, std::vector<uint32_t> *result);
+    /*
+     * ITU-R BS.775 style mixing matrix from channels (as returned by
+     * getChannels()) to the layout given by bitmap: a row per output
+     * channel, a column per input channel. A channel missing in the output
+     * is folded into its neighbours at -3dB; LFE is dropped. Output
+     * channels missing in the input are silent.
+     */
+    void getDownmixMatrix(const std::vector<uint32_t> &channels,
+                          uint32_t bitmap,
+                          std::vector<std::vector<double> > *result);
 }
 
+/*
+ * Reorders channels in place. The permutation of a frame is turned into
+ * shuffle masks once in the constructor; pshufb (or vpermd for 32bit
+ * samples) then handles as many whole frames as fit in a register.
+ */
 class ChannelMapper: public FilterBase {
     std::vector<uint32_t> m_chanmap;
     std::vector<uint32_t> m_layout;
+    std::vector<char> m_frame;
+    /* frames per register, 0 when frames are done one by one */
+    unsigned m_group;
+    bool m_avx2;
+    uint8_t m_mask[16];
+    uint32_t m_index[8];
 public:
     ChannelMapper(const std::shared_ptr<ISource> &source,
                   const std::vector<uint32_t> &chanmap, uint32_t bitmap=0);
@@ -34,4 +56,32 @@ public:
     size_t readSamples(void *buffer, size_t nsamples);
 };
 
+/*
+ * Mixes channels by a matrix (a row per output channel, a column per input
+ * channel) into float. bitmap is the channel mask of the output, or 0.
+ */
+class ChannelMixer: public FilterBase {
+    AudioStreamBasicDescription m_asbd;
+    std::vector<uint32_t> m_layout;
+    std::vector<float> m_coefs;
+    std::vector<float> m_ibuffer;
+    util::AlignedBuffer m_pivot;
+    const mixkernel::Kernel *m_kernel;
+public:
+    ChannelMixer(const std::shared_ptr<ISource> &source,
+                 const std::vector<std::vector<double> > &matrix,
+                 uint32_t bitmap=0);
+    const AudioStreamBasicDescription &getSampleFormat() const
+    {
+        return m_asbd;
+    }
+    const std::vector<uint32_t> *getChannels() const
+    {
+        return m_layout.size() ? &m_layout : 0;
+    }
+    size_t readSamples(void *buffer, size_t nsamples);
+    bool isSeekable();
+    void seekTo(int64_t position) { seekSource(position); }
+};
+
 #endif
@@ -0,0 +1,64 @@
+#include "convkernel.h"
+#include "cpuinfo.h"
+
+namespace convkernel {
+    namespace {
+        void intToFloat_c(const int *src, float *dst, size_t count)
+        {
+            for (size_t i = 0; i < count; ++i)
+                dst[i] = src[i] / 2147483648.0f;
+        }
+
+        /*
+         * Exact for every 32bit value. Before the kernels, the 64bit path
+         * divided by a float constant, which rounded 32bit integer input
+         * to 24 bits; 16/24bit input is converted as before.
+         */
+        void intToDouble_c(const int *src, double *dst, size_t count)
+        {
+            for (size_t i = 0; i < count; ++i)
+                dst[i] = src[i] / 2147483648.0;
+        }
+
+        void floatToDouble_c(const float *src, double *dst, size_t count)
+        {
+            for (size_t i = 0; i < count; ++i)
+                dst[i] = src[i];
+        }
+
+        /*
+         * Adding and subtracting a tiny normal number leaves normal
+         * values as they are, but rounds denormals to zero.
+         */
+        void doubleToFloat_c(const double *src, float *dst, size_t count)
+        {
+            const float anti_denormal = 1.0e-30f;
+            for (size_t i = 0; i < count; ++i) {
+                float x = static_cast<float>(src[i]);
+                x += anti_denormal;
+                x -= anti_denormal;
+                dst[i] = x;
+            }
+        }
+    }
+
+    const Kernel &scalar()
+    {
+        static const Kernel k = {
+            "scalar", intToFloat_c, intToDouble_c, floatToDouble_c,
+            doubleToFloat_c
+        };
+        return k;
+    }
+
+#if !defined(_M_IX86) && !defined(_M_X64) && !defined(__i386__) \
+    && !defined(__x86_64__)
+    const Kernel &avx2() { return scalar(); }
+#endif
+
+    const Kernel &get()
+    {
+        static const Kernel &k = cpuinfo::avx2() ? avx2() : scalar();
+        return k;
+    }
+}
@@ -0,0 +1,28 @@
+#ifndef CONVKERNEL_H
+#define CONVKERNEL_H
+
+#include <cstddef>
+
+/*
+ * Sample format conversions in front of the float pipeline, selected at
+ * runtime by CPU features like firkernel.
+ * Integers are 32bit full scale, mapped to [-1.0, 1.0).
+ */
+namespace convkernel {
+    struct Kernel {
+        const char *name;
+        void (*intToFloat)(const int *src, float *dst, size_t count);
+        void (*intToDouble)(const int *src, double *dst, size_t count);
+        void (*floatToDouble)(const float *src, double *dst, size_t count);
+        /* denormals (after rounding to float) are flushed to zero */
+        void (*doubleToFloat)(const double *src, float *dst, size_t count);
+    };
+
+    const Kernel &scalar();
+    const Kernel &avx2();
+
+    /* the best one available on this CPU */
+    const Kernel &get();
+}
+
+#endif
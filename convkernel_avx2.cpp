@@ -0,0 +1,85 @@
+#include "convkernel.h"
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) \
+    || defined(__x86_64__)
+#include <immintrin.h>
+
+/* see firkernel_avx2.cpp */
+#if defined(__GNUC__)
+#define AVX2_TARGET __attribute__((target("avx2")))
+#else
+#define AVX2_TARGET
+#endif
+
+/*
+ * Same operations as the scalar versions in the same order, so that the
+ * results are bit-identical.
+ */
+namespace convkernel {
+    namespace {
+        AVX2_TARGET
+        void intToFloat_avx2(const int *src, float *dst, size_t count)
+        {
+            const __m256 scale = _mm256_set1_ps(1.0f / 2147483648.0f);
+            size_t i = 0;
+            for (; i + 8 <= count; i += 8) {
+                __m256i v = _mm256_loadu_si256(
+                    reinterpret_cast<const __m256i*>(src + i));
+                _mm256_storeu_ps(dst + i,
+                                 _mm256_mul_ps(_mm256_cvtepi32_ps(v), scale));
+            }
+            scalar().intToFloat(src + i, dst + i, count - i);
+        }
+
+        AVX2_TARGET
+        void intToDouble_avx2(const int *src, double *dst, size_t count)
+        {
+            const __m256d scale = _mm256_set1_pd(1.0 / 2147483648.0);
+            size_t i = 0;
+            for (; i + 4 <= count; i += 4) {
+                __m128i v = _mm_loadu_si128(
+                    reinterpret_cast<const __m128i*>(src + i));
+                _mm256_storeu_pd(dst + i,
+                                 _mm256_mul_pd(_mm256_cvtepi32_pd(v), scale));
+            }
+            scalar().intToDouble(src + i, dst + i, count - i);
+        }
+
+        AVX2_TARGET
+        void floatToDouble_avx2(const float *src, double *dst, size_t count)
+        {
+            size_t i = 0;
+            for (; i + 4 <= count; i += 4)
+                _mm256_storeu_pd(dst + i,
+                                 _mm256_cvtps_pd(_mm_loadu_ps(src + i)));
+            scalar().floatToDouble(src + i, dst + i, count - i);
+        }
+
+        AVX2_TARGET
+        void doubleToFloat_avx2(const double *src, float *dst, size_t count)
+        {
+            const __m256 anti_denormal = _mm256_set1_ps(1.0e-30f);
+            size_t i = 0;
+            for (; i + 8 <= count; i += 8) {
+                __m128 lo = _mm256_cvtpd_ps(_mm256_loadu_pd(src + i));
+                __m128 hi = _mm256_cvtpd_ps(_mm256_loadu_pd(src + i + 4));
+                __m256 x = _mm256_insertf128_ps(_mm256_castps128_ps256(lo),
+                                                hi, 1);
+                x = _mm256_add_ps(x, anti_denormal);
+                x = _mm256_sub_ps(x, anti_denormal);
+                _mm256_storeu_ps(dst + i, x);
+            }
+            scalar().doubleToFloat(src + i, dst + i, count - i);
+        }
+    }
+
+    const Kernel &avx2()
+    {
+        static const Kernel k = {
+            "avx2", intToFloat_avx2, intToDouble_avx2, floatToDouble_avx2,
+            doubleToFloat_avx2
+        };
+        return k;
+    }
+}
+
+#endif
@@ -0,0 +1,74 @@
+#include "cpuinfo.h"
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+#include <intrin.h>
+#define CPUID_X86 1
+#elif defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#include <cpuid.h>
+#define CPUID_X86 1
+#endif
+
+namespace cpuinfo {
+    namespace {
+#ifdef CPUID_X86
+        void query(unsigned leaf, unsigned regs[4])
+        {
+#ifdef _MSC_VER
+            int r[4];
+            __cpuidex(r, leaf, 0);
+            for (int i = 0; i < 4; ++i)
+                regs[i] = r[i];
+#else
+            __cpuid_count(leaf, 0, regs[0], regs[1], regs[2], regs[3]);
+#endif
+        }
+
+        unsigned long long xgetbv0()
+        {
+#ifdef _MSC_VER
+            return _xgetbv(0);
+#else
+            unsigned lo, hi;
+            __asm__ __volatile__ ("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+            return (static_cast<unsigned long long>(hi) << 32) | lo;
+#endif
+        }
+#endif
+
+        struct Features {
+            bool sse2, ssse3, avx2;
+            Features(): sse2(false), ssse3(false), avx2(false)
+            {
+#ifdef CPUID_X86
+                unsigned regs[4];
+                query(0, regs);
+                unsigned maxleaf = regs[0];
+                if (maxleaf < 1)
+                    return;
+                query(1, regs);
+                sse2  = (regs[3] & (1 << 26)) != 0;
+                ssse3 = (regs[2] & (1 << 9)) != 0;
+                bool fma     = (regs[2] & (1 << 12)) != 0;
+                bool osxsave = (regs[2] & (1 << 27)) != 0;
+                bool avx     = (regs[2] & (1 << 28)) != 0;
+                if (maxleaf < 7 || !fma || !osxsave || !avx)
+                    return;
+                /* XMM and YMM state must be enabled by the OS */
+                if ((xgetbv0() & 6) != 6)
+                    return;
+                query(7, regs);
+                avx2 = (regs[1] & (1 << 5)) != 0;
+#endif
+            }
+        };
+
+        const Features &features()
+        {
+            static Features f;
+            return f;
+        }
+    }
+
+    bool sse2()  { return features().sse2;  }
+    bool ssse3() { return features().ssse3; }
+    bool avx2()  { return features().avx2;  }
+}
@@ -0,0 +1,15 @@
+#ifndef CPUINFO_H
+#define CPUINFO_H
+
+/*
+ * Runtime detection of x86 SIMD extensions.
+ * Always false on other architectures.
+ */
+namespace cpuinfo {
+    bool sse2();
+    bool ssse3();
+    /* AVX2 + FMA3, with OS support for YMM state */
+    bool avx2();
+}
+
+#endif
@@ -0,0 +1,92 @@
+#include <cmath>
+#include <algorithm>
+#include "ditherkernel.h"
+#include "cpuinfo.h"
+
+namespace ditherkernel {
+    namespace {
+        inline uint32_t mulhilo(uint32_t a, uint32_t b, uint32_t *hi)
+        {
+            uint64_t product = static_cast<uint64_t>(a) * b;
+            *hi = static_cast<uint32_t>(product >> 32);
+            return static_cast<uint32_t>(product);
+        }
+
+        /* Philox4x32-10 (Salmon et al., "Parallel random numbers: as easy
+         * as 1, 2, 3") of counter (block, 0), key (seed, 0) */
+        void philox(uint32_t seed, uint64_t block, uint32_t out[4])
+        {
+            uint32_t c[4] = {
+                static_cast<uint32_t>(block),
+                static_cast<uint32_t>(block >> 32), 0, 0
+            };
+            uint32_t k0 = seed, k1 = 0;
+            for (int round = 0; round < 10; ++round) {
+                uint32_t hi0, hi1;
+                uint32_t lo0 = mulhilo(0xD2511F53, c[0], &hi0);
+                uint32_t lo1 = mulhilo(0xCD9E8D57, c[2], &hi1);
+                c[0] = hi1 ^ c[1] ^ k0;
+                c[1] = lo1;
+                c[2] = hi0 ^ c[3] ^ k1;
+                c[3] = lo0;
+                k0 += 0x9E3779B9;
+                k1 += 0xBB67AE85;
+            }
+            std::copy(c, c + 4, out);
+        }
+
+        /* difference of two 16bit uniforms, in LSB */
+        inline double tpdf(uint32_t r)
+        {
+            return (static_cast<int>(r >> 16) - static_cast<int>(r & 0xffff))
+                   * (1.0 / 65536.0);
+        }
+
+        void noise_c(uint32_t seed, uint64_t index, double *dst,
+                     size_t count)
+        {
+            uint32_t words[4];
+            for (size_t i = 0; i < count; ++i, ++index) {
+                if (i == 0 || index % 4 == 0)
+                    philox(seed, index / 4, words);
+                dst[i] = tpdf(words[index % 4]);
+            }
+        }
+
+        template <typename T>
+        void quantize_c(const T *src, const double *noise, int *dst,
+                        size_t count, unsigned depth)
+        {
+            const int shifts = 32 - depth;
+            const double half = 1U << (depth - 1);
+            const double min_value = -half;
+            const double max_value = half - 1;
+            for (size_t i = 0; i < count; ++i) {
+                double value = src[i] * half;
+                if (noise)
+                    value += noise[i];
+                value = std::min(std::max(value, min_value), max_value);
+                dst[i] = static_cast<int>(lrint(value)) << shifts;
+            }
+        }
+    }
+
+    const Kernel &scalar()
+    {
+        static const Kernel k = {
+            "scalar", noise_c, quantize_c<float>, quantize_c<double>
+        };
+        return k;
+    }
+
+#if !defined(_M_IX86) && !defined(_M_X64) && !defined(__i386__) \
+    && !defined(__x86_64__)
+    const Kernel &avx2() { return scalar(); }
+#endif
+
+    const Kernel &get()
+    {
+        static const Kernel &k = cpuinfo::avx2() ? avx2() : scalar();
+        return k;
+    }
+}
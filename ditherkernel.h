@@ -0,0 +1,40 @@
+#ifndef DITHERKERNEL_H
+#define DITHERKERNEL_H
+
+#include <cstddef>
+#include <stdint.h>
+
+/*
+ * Quantization of float samples to integers with TPDF dither, selected at
+ * runtime by CPU features like firkernel.
+ *
+ * Dither noise is counter based: the noise of the sample at index i
+ * (frame * channels + channel, from the start of the stream) is a pure
+ * function of seed and i, taken from Philox4x32-10 with counter i / 4 and
+ * word i % 4. Therefore any block can be generated on its own, on any
+ * thread, and the result doesn't depend on the block size or the CPU.
+ */
+namespace ditherkernel {
+    struct Kernel {
+        const char *name;
+        /* TPDF noise in (-1, 1) LSB for samples index ... index + count - 1 */
+        void (*noise)(uint32_t seed, uint64_t index, double *dst,
+                      size_t count);
+        /*
+         * dst[i] = round(clip(src[i] * 2^(depth-1) + noise[i])) << (32-depth)
+         * noise can be null (no dither).
+         */
+        void (*quantizeFloat)(const float *src, const double *noise,
+                              int *dst, size_t count, unsigned depth);
+        void (*quantizeDouble)(const double *src, const double *noise,
+                               int *dst, size_t count, unsigned depth);
+    };
+
+    const Kernel &scalar();
+    const Kernel &avx2();
+
+    /* the best one available on this CPU */
+    const Kernel &get();
+}
+
+#endif
@@ -0,0 +1,179 @@
+#include "ditherkernel.h"
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) \
+    || defined(__x86_64__)
+#include <immintrin.h>
+
+/* see firkernel_avx2.cpp */
+#if defined(__GNUC__)
+#define AVX2_TARGET __attribute__((target("avx2")))
+#else
+#define AVX2_TARGET
+#endif
+
+namespace ditherkernel {
+    namespace {
+        /* 32x32 -> 64bit products of 8 lanes, split into hi and lo */
+        AVX2_TARGET
+        inline __m256i mulhilo(__m256i a, __m256i b, __m256i *hi)
+        {
+            __m256i even = _mm256_mul_epu32(a, b);
+            __m256i odd = _mm256_mul_epu32(_mm256_srli_epi64(a, 32),
+                                           _mm256_srli_epi64(b, 32));
+            *hi = _mm256_blend_epi32(_mm256_srli_epi64(even, 32), odd, 0xaa);
+            return _mm256_blend_epi32(even, _mm256_slli_epi64(odd, 32), 0xaa);
+        }
+
+        /* Philox4x32-10 of 8 consecutive counters from block */
+        AVX2_TARGET
+        inline void philox8(uint32_t seed, uint64_t block, __m256i c[4])
+        {
+            const __m256i m0 = _mm256_set1_epi32(0xD2511F53);
+            const __m256i m1 = _mm256_set1_epi32(0xCD9E8D57);
+            uint32_t lo[8], hi[8];
+            for (int j = 0; j < 8; ++j) {
+                lo[j] = static_cast<uint32_t>(block + j);
+                hi[j] = static_cast<uint32_t>((block + j) >> 32);
+            }
+            c[0] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(lo));
+            c[1] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(hi));
+            c[2] = _mm256_setzero_si256();
+            c[3] = _mm256_setzero_si256();
+            uint32_t k0 = seed, k1 = 0;
+            for (int round = 0; round < 10; ++round) {
+                __m256i hi0, hi1;
+                __m256i lo0 = mulhilo(m0, c[0], &hi0);
+                __m256i lo1 = mulhilo(m1, c[2], &hi1);
+                c[0] = _mm256_xor_si256(_mm256_xor_si256(hi1, c[1]),
+                                        _mm256_set1_epi32(k0));
+                c[1] = lo1;
+                c[2] = _mm256_xor_si256(_mm256_xor_si256(hi0, c[3]),
+                                        _mm256_set1_epi32(k1));
+                c[3] = lo0;
+                k0 += 0x9E3779B9;
+                k1 += 0xBB67AE85;
+            }
+        }
+
+        AVX2_TARGET
+        inline void storeNoise(__m256i r, double *dst)
+        {
+            const __m256d lsb = _mm256_set1_pd(1.0 / 65536.0);
+            const __m256i mask = _mm256_set1_epi32(0xffff);
+            __m256i n = _mm256_sub_epi32(_mm256_srli_epi32(r, 16),
+                                         _mm256_and_si256(r, mask));
+            __m256d lo = _mm256_cvtepi32_pd(_mm256_castsi256_si128(n));
+            __m256d hi = _mm256_cvtepi32_pd(_mm256_extracti128_si256(n, 1));
+            _mm256_storeu_pd(dst, _mm256_mul_pd(lsb, lo));
+            _mm256_storeu_pd(dst + 4, _mm256_mul_pd(lsb, hi));
+        }
+
+        /*
+         * 32 samples (8 counters) per loop. Word w of counter j goes to
+         * sample 4j + w, so the 4x8 words are transposed first.
+         */
+        AVX2_TARGET
+        void noise_avx2(uint32_t seed, uint64_t index, double *dst,
+                        size_t count)
+        {
+            size_t i = 0;
+            if (index % 4) {
+                i = 4 - index % 4;
+                if (i > count)
+                    i = count;
+                scalar().noise(seed, index, dst, i);
+            }
+            for (; i + 32 <= count; i += 32) {
+                __m256i c[4];
+                philox8(seed, (index + i) / 4, c);
+                __m256i t0 = _mm256_unpacklo_epi32(c[0], c[1]);
+                __m256i t1 = _mm256_unpacklo_epi32(c[2], c[3]);
+                __m256i t2 = _mm256_unpackhi_epi32(c[0], c[1]);
+                __m256i t3 = _mm256_unpackhi_epi32(c[2], c[3]);
+                /* counters 0/4, 1/5, 2/6, 3/7 in the low/high lane */
+                __m256i a = _mm256_unpacklo_epi64(t0, t1);
+                __m256i b = _mm256_unpackhi_epi64(t0, t1);
+                __m256i e = _mm256_unpacklo_epi64(t2, t3);
+                __m256i f = _mm256_unpackhi_epi64(t2, t3);
+                storeNoise(_mm256_permute2x128_si256(a, b, 0x20), dst + i);
+                storeNoise(_mm256_permute2x128_si256(e, f, 0x20), dst + i + 8);
+                storeNoise(_mm256_permute2x128_si256(a, b, 0x31),
+                           dst + i + 16);
+                storeNoise(_mm256_permute2x128_si256(e, f, 0x31),
+                           dst + i + 24);
+            }
+            if (i < count)
+                scalar().noise(seed, index + i, dst + i, count - i);
+        }
+
+        AVX2_TARGET
+        inline void load(const float *src, __m256d *lo, __m256d *hi)
+        {
+            __m256 v = _mm256_loadu_ps(src);
+            *lo = _mm256_cvtps_pd(_mm256_castps256_ps128(v));
+            *hi = _mm256_cvtps_pd(_mm256_extractf128_ps(v, 1));
+        }
+
+        AVX2_TARGET
+        inline void load(const double *src, __m256d *lo, __m256d *hi)
+        {
+            *lo = _mm256_loadu_pd(src);
+            *hi = _mm256_loadu_pd(src + 4);
+        }
+
+        inline void quantizeTail(const float *src, const double *noise,
+                                 int *dst, size_t count, unsigned depth)
+        {
+            scalar().quantizeFloat(src, noise, dst, count, depth);
+        }
+
+        inline void quantizeTail(const double *src, const double *noise,
+                                 int *dst, size_t count, unsigned depth)
+        {
+            scalar().quantizeDouble(src, noise, dst, count, depth);
+        }
+
+        /* 8 samples per loop, computed in double like the scalar one */
+        template <typename T>
+        AVX2_TARGET
+        void quantize_avx2(const T *src, const double *noise, int *dst,
+                           size_t count, unsigned depth)
+        {
+            const __m128i shifts = _mm_cvtsi32_si128(32 - depth);
+            const double half = 1U << (depth - 1);
+            const __m256d scale = _mm256_set1_pd(half);
+            const __m256d min_value = _mm256_set1_pd(-half);
+            const __m256d max_value = _mm256_set1_pd(half - 1);
+            size_t i = 0;
+            for (; i + 8 <= count; i += 8) {
+                __m256d lo, hi;
+                load(src + i, &lo, &hi);
+                lo = _mm256_mul_pd(lo, scale);
+                hi = _mm256_mul_pd(hi, scale);
+                if (noise) {
+                    lo = _mm256_add_pd(lo, _mm256_loadu_pd(noise + i));
+                    hi = _mm256_add_pd(hi, _mm256_loadu_pd(noise + i + 4));
+                }
+                lo = _mm256_min_pd(_mm256_max_pd(lo, min_value), max_value);
+                hi = _mm256_min_pd(_mm256_max_pd(hi, min_value), max_value);
+                __m256i v = _mm256_inserti128_si256(
+                    _mm256_castsi128_si256(_mm256_cvtpd_epi32(lo)),
+                    _mm256_cvtpd_epi32(hi), 1);
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i),
+                                    _mm256_sll_epi32(v, shifts));
+            }
+            if (i < count)
+                quantizeTail(src + i, noise ? noise + i : 0, dst + i,
+                             count - i, depth);
+        }
+    }
+
+    const Kernel &avx2()
+    {
+        static const Kernel k = {
+            "avx2", noise_avx2, quantize_avx2<float>, quantize_avx2<double>
+        };
+        return k;
+    }
+}
+
+#endif
@@ -0,0 +1,237 @@
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <fcntl.h>
+#if defined(_MSC_VER) || defined(__MINGW32__)
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+#include "filtercache.h"
+#include "mmapfile.h"
+#include "util.h"
+#ifdef _WIN32
+#include "win32util.h"
+#endif
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+namespace filtercache {
+    namespace {
+        /*
+         * Of a halfband stage, in_rate is the attenuation, out_rate the
+         * transition width, and the rest is zero.
+         */
+        struct Key {
+            double in_rate, out_rate, bandwidth;
+            int quality;
+            unsigned nphases;
+            bool minphase;
+            bool halfband;
+            bool wide;
+            bool operator<(const Key &k) const
+            {
+                if (in_rate != k.in_rate) return in_rate < k.in_rate;
+                if (out_rate != k.out_rate) return out_rate < k.out_rate;
+                if (bandwidth != k.bandwidth) return bandwidth < k.bandwidth;
+                if (quality != k.quality) return quality < k.quality;
+                if (nphases != k.nphases) return nphases < k.nphases;
+                if (minphase != k.minphase) return minphase < k.minphase;
+                if (halfband != k.halfband) return halfband < k.halfband;
+                return wide < k.wide;
+            }
+        };
+
+        /*
+         * On-disk layout: this header followed by the coefficients in
+         * native byte order. Bump version when the design changes.
+         */
+        struct FileHeader {
+            char magic[4];
+            uint32_t version;
+            uint32_t nphases;
+            uint32_t ntaps;
+            double in_rate;
+            double out_rate;
+            double bandwidth;
+            int32_t quality;
+            uint32_t flags;
+        };
+        /* FileHeader::flags */
+        const uint32_t kMinimumPhase = 1;
+        const uint32_t kHalfband = 2;
+        const uint32_t kWide = 4;
+        const uint32_t kVersion = 1;
+
+        std::mutex g_mutex;
+        std::map<Key, std::shared_ptr<const PolyphaseFilter> > g_filters;
+        std::wstring g_directory;
+
+        FileHeader makeHeader(const Key &key, unsigned ntaps)
+        {
+            FileHeader h = { { 'P', 'P', 'F', 'B' } };
+            h.version = kVersion;
+            h.nphases = key.nphases;
+            h.ntaps = ntaps;
+            h.in_rate = key.in_rate;
+            h.out_rate = key.out_rate;
+            h.bandwidth = key.bandwidth;
+            h.quality = key.quality;
+            h.flags = (key.minphase ? kMinimumPhase : 0)
+                    | (key.halfband ? kHalfband : 0)
+                    | (key.wide ? kWide : 0);
+            return h;
+        }
+
+        std::wstring filePath(const Key &key)
+        {
+#ifdef _WIN32
+            const wchar_t *sep = L"\\";
+#else
+            const wchar_t *sep = L"/";
+#endif
+            if (key.halfband)
+                return strutil::format(L"%ls%lshalfband_a%.6f_t%.9f%ls.bin",
+                                       g_directory.c_str(), sep,
+                                       key.in_rate, key.out_rate,
+                                       key.minphase ? L"_mp" : L"");
+            return strutil::format(
+                L"%ls%lspolyphase_%.0f_%.0f_q%d_w%.6f_%u%ls%ls.bin",
+                g_directory.c_str(), sep, key.in_rate, key.out_rate,
+                key.quality, key.bandwidth, key.nphases,
+                key.minphase ? L"_mp" : L"", key.wide ? L"_wide" : L"");
+        }
+
+        int openFile(const std::wstring &path, int flags)
+        {
+#ifdef _WIN32
+            return _wopen(win32::prefixed_path(path.c_str()).c_str(),
+                          flags | O_BINARY, 0644);
+#else
+            return open(strutil::w2m(path).c_str(), flags, 0644);
+#endif
+        }
+
+        /* write() returns int on Windows and ssize_t elsewhere */
+        bool writeAll(int fd, const void *data, size_t size)
+        {
+            return write(fd, data, size) == static_cast<int64_t>(size);
+        }
+
+        std::shared_ptr<const PolyphaseFilter> load(const Key &key)
+        {
+            std::shared_ptr<const PolyphaseFilter> result;
+            int fd = openFile(filePath(key), O_RDONLY);
+            if (fd < 0)
+                return result;
+            std::shared_ptr<MappedFile> mapping;
+            try {
+                mapping = std::make_shared<MappedFile>(fd);
+            } catch (...) {}
+            close(fd);
+            if (!mapping || mapping->size() < sizeof(FileHeader))
+                return result;
+
+            FileHeader h;
+            std::memcpy(&h, mapping->data(), sizeof h);
+            FileHeader expected = makeHeader(key, h.ntaps);
+            uint64_t size = sizeof h + static_cast<uint64_t>(h.nphases + 1)
+                                     * h.ntaps * sizeof(float);
+            if (std::memcmp(&h, &expected, sizeof h) || mapping->size() != size)
+                return result;
+
+            const float *coefs =
+                reinterpret_cast<const float*>(mapping->data() + sizeof h);
+            result = std::make_shared<PolyphaseFilter>(
+                h.nphases, h.ntaps, coefs, mapping, key.minphase,
+                key.halfband && !key.minphase);
+            return result;
+        }
+
+        /*
+         * Best effort: written to a temporary name and then renamed, so that
+         * concurrent processes never see a partial file.
+         */
+        void save(const Key &key, const PolyphaseFilter &filter)
+        {
+            std::wstring path = filePath(key);
+#ifdef _WIN32
+            std::wstring tmppath =
+                strutil::format(L"%ls.%d.tmp", path.c_str(), _getpid());
+#else
+            std::wstring tmppath =
+                strutil::format(L"%ls.%d.tmp", path.c_str(), getpid());
+#endif
+            int fd = openFile(tmppath, O_WRONLY | O_CREAT | O_TRUNC);
+            if (fd < 0)
+                return;
+            FileHeader h = makeHeader(key, filter.ntaps());
+            size_t bytes = filter.size() * sizeof(float);
+            bool ok = writeAll(fd, &h, sizeof h)
+                   && writeAll(fd, filter.data(), bytes);
+            ok = (close(fd) == 0) && ok;
+#ifdef _WIN32
+            std::wstring from = win32::prefixed_path(tmppath.c_str());
+            std::wstring to = win32::prefixed_path(path.c_str());
+            if (!ok || !MoveFileExW(from.c_str(), to.c_str(),
+                                    MOVEFILE_REPLACE_EXISTING))
+                _wunlink(from.c_str());
+#else
+            std::string from = strutil::w2m(tmppath);
+            if (!ok || std::rename(from.c_str(), strutil::w2m(path).c_str()))
+                unlink(from.c_str());
+#endif
+        }
+
+        std::shared_ptr<const PolyphaseFilter> lookup(const Key &key)
+        {
+            std::lock_guard<std::mutex> lock(g_mutex);
+
+            std::shared_ptr<const PolyphaseFilter> &entry = g_filters[key];
+            if (entry)
+                return entry;
+            if (!g_directory.empty())
+                entry = load(key);
+            if (!entry) {
+                std::shared_ptr<const PolyphaseFilter> filter;
+                if (key.halfband)
+                    filter = PolyphaseFilter::halfband(key.in_rate,
+                                                       key.out_rate,
+                                                       key.minphase);
+                else
+                    filter = std::make_shared<PolyphaseFilter>(
+                        key.in_rate, key.out_rate, key.quality,
+                        key.bandwidth, key.nphases, key.minphase, key.wide);
+                if (!g_directory.empty())
+                    save(key, *filter);
+                entry = filter;
+            }
+            return entry;
+        }
+    }
+
+    std::shared_ptr<const PolyphaseFilter>
+        get(double in_rate, double out_rate, int quality, double bandwidth,
+            unsigned nphases, bool minphase, bool wide)
+    {
+        Key key = { in_rate, out_rate, bandwidth, quality, nphases,
+                    minphase, false, wide };
+        return lookup(key);
+    }
+
+    std::shared_ptr<const PolyphaseFilter>
+        halfband(double attenuation, double transition, bool minphase)
+    {
+        Key key = { attenuation, transition, 0.0, 0, 1, minphase, true,
+                    false };
+        return lookup(key);
+    }
+
+    void setDirectory(const std::wstring &dir)
+    {
+        std::lock_guard<std::mutex> lock(g_mutex);
+        g_directory = dir;
+    }
+}
@@ -0,0 +1,27 @@
+#ifndef FILTERCACHE_H
+#define FILTERCACHE_H
+
+#include <string>
+#include "PolyphaseResampler.h"
+
+/*
+ * Process wide cache of designed PolyphaseFilters.
+ * When a directory is set, tables are also saved there and memory mapped
+ * by later runs, so that coefficient design is done only once for each
+ * set of parameters.
+ */
+namespace filtercache {
+    std::shared_ptr<const PolyphaseFilter>
+        get(double in_rate, double out_rate, int quality, double bandwidth,
+            unsigned nphases=256, bool minphase=false, bool wide=false);
+
+    /* PolyphaseFilter::halfband(), cached the same way */
+    std::shared_ptr<const PolyphaseFilter>
+        halfband(double attenuation, double transition,
+                 bool minphase=false);
+
+    /* empty string disables the persistent cache */
+    void setDirectory(const std::wstring &dir);
+}
+
+#endif
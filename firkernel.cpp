@@ -0,0 +1,326 @@
+#include "firkernel.h"
+#include "cpuinfo.h"
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) \
+    || defined(__x86_64__)
+#include <emmintrin.h>
+#define FIRKERNEL_X86 1
+#endif
+
+namespace firkernel {
+    namespace {
+        void interpolate_c(const float *c0, const float *c1, float frac,
+                           float *dst, unsigned ntaps)
+        {
+            for (unsigned k = 0; k < ntaps; ++k)
+                dst[k] = c0[k] + frac * (c1[k] - c0[k]);
+        }
+
+        /* one plane */
+        float convolve_c(const float *coefs, const float *x, unsigned ntaps)
+        {
+            float sum = 0.0f;
+            for (unsigned k = 0; k < ntaps; ++k)
+                sum += coefs[k] * x[k];
+            return sum;
+        }
+
+        void convolvePlanar_c(const float *coefs, const float * const *x,
+                              size_t index, unsigned ntaps,
+                              unsigned nchannels, float * const *out,
+                              size_t offset)
+        {
+            for (unsigned ch = 0; ch < nchannels; ++ch)
+                out[ch][offset] = convolve_c(coefs, x[ch] + index, ntaps);
+        }
+
+        void convolvePlanar64_c(const float *coefs,
+                                const double * const *x, size_t index,
+                                unsigned ntaps, unsigned nchannels,
+                                double * const *out, size_t offset)
+        {
+            for (unsigned ch = 0; ch < nchannels; ++ch) {
+                const double *xp = x[ch] + index;
+                double sum = 0.0;
+                for (unsigned k = 0; k < ntaps; ++k)
+                    sum += coefs[k] * xp[k];
+                out[ch][offset] = sum;
+            }
+        }
+
+        void decimateHalfband_c(const float *coefs, unsigned ntaps,
+                                float center, unsigned cpos,
+                                const float *x, float *out, size_t count)
+        {
+            for (size_t i = 0; i < count; ++i) {
+                const float *xp = x + 2 * i;
+                float sum = center * xp[2 * cpos + 1];
+                for (unsigned k = 0; k < ntaps; ++k)
+                    sum += coefs[k] * xp[2 * k];
+                out[i] = sum;
+            }
+        }
+
+        void decimateHalfband64_c(const float *coefs, unsigned ntaps,
+                                  float center, unsigned cpos,
+                                  const double *x, double *out,
+                                  size_t count)
+        {
+            for (size_t i = 0; i < count; ++i) {
+                const double *xp = x + 2 * i;
+                double sum = center * xp[2 * cpos + 1];
+                for (unsigned k = 0; k < ntaps; ++k)
+                    sum += coefs[k] * xp[2 * k];
+                out[i] = sum;
+            }
+        }
+
+#ifdef FIRKERNEL_X86
+        inline float hsum(__m128 v)
+        {
+            v = _mm_add_ps(v, _mm_movehl_ps(v, v));
+            v = _mm_add_ss(v, _mm_shuffle_ps(v, v, 1));
+            return _mm_cvtss_f32(v);
+        }
+
+        void interpolate_sse2(const float *c0, const float *c1, float frac,
+                              float *dst, unsigned ntaps)
+        {
+            __m128 f = _mm_set1_ps(frac);
+            unsigned k = 0;
+            for (; k + 4 <= ntaps; k += 4) {
+                __m128 a = _mm_loadu_ps(c0 + k);
+                __m128 b = _mm_loadu_ps(c1 + k);
+                b = _mm_mul_ps(f, _mm_sub_ps(b, a));
+                _mm_storeu_ps(dst + k, _mm_add_ps(a, b));
+            }
+            for (; k < ntaps; ++k)
+                dst[k] = c0[k] + frac * (c1[k] - c0[k]);
+        }
+
+        void convolve1_sse2(const float *c, const float *x, unsigned ntaps,
+                            float *out)
+        {
+            __m128 acc0 = _mm_setzero_ps(), acc1 = _mm_setzero_ps();
+            unsigned k = 0;
+            for (; k + 8 <= ntaps; k += 8) {
+                acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(c + k),
+                                                   _mm_loadu_ps(x + k)));
+                acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(c + k + 4),
+                                                   _mm_loadu_ps(x + k + 4)));
+            }
+            float sum = hsum(_mm_add_ps(acc0, acc1));
+            for (; k < ntaps; ++k)
+                sum += c[k] * x[k];
+            out[0] = sum;
+        }
+
+        void convolvePlanar_sse2(const float *coefs, const float * const *x,
+                                 size_t index, unsigned ntaps,
+                                 unsigned nchannels, float * const *out,
+                                 size_t offset)
+        {
+            for (unsigned ch = 0; ch < nchannels; ++ch)
+                convolve1_sse2(coefs, x[ch] + index, ntaps,
+                               out[ch] + offset);
+        }
+
+        /* 4 coefficients converted to 2 vectors of double */
+        void convolvePlanar64_sse2(const float *c, const double * const *x,
+                                   size_t index, unsigned ntaps,
+                                   unsigned nchannels, double * const *out,
+                                   size_t offset)
+        {
+            for (unsigned ch = 0; ch < nchannels; ++ch) {
+                const double *xp = x[ch] + index;
+                __m128d acc0 = _mm_setzero_pd(), acc1 = _mm_setzero_pd();
+                unsigned k = 0;
+                for (; k + 4 <= ntaps; k += 4) {
+                    __m128 cc = _mm_loadu_ps(c + k);
+                    acc0 = _mm_add_pd(acc0,
+                                      _mm_mul_pd(_mm_cvtps_pd(cc),
+                                                 _mm_loadu_pd(xp + k)));
+                    acc1 = _mm_add_pd(acc1,
+                                      _mm_mul_pd(_mm_cvtps_pd(
+                                                     _mm_movehl_ps(cc, cc)),
+                                                 _mm_loadu_pd(xp + k + 2)));
+                }
+                __m128d acc = _mm_add_pd(acc0, acc1);
+                acc = _mm_add_sd(acc, _mm_unpackhi_pd(acc, acc));
+                double sum = _mm_cvtsd_f64(acc);
+                for (; k < ntaps; ++k)
+                    sum += c[k] * xp[k];
+                out[ch][offset] = sum;
+            }
+        }
+
+        /* p[0], p[2], ... p[2 * (n - 1)], zero for the other lanes */
+        inline __m128 loadEvens(const float *p, unsigned n)
+        {
+            return _mm_setr_ps(p[0], n > 1 ? p[2] : 0.0f,
+                               n > 2 ? p[4] : 0.0f, n > 3 ? p[6] : 0.0f);
+        }
+
+        inline __m128d loadEvens64(const double *p, unsigned n)
+        {
+            return _mm_setr_pd(p[0], n > 1 ? p[2] : 0.0);
+        }
+
+        /*
+         * Outputs are in the lanes, 4 at a time, and taps are broadcast.
+         * The even samples of two vectors are picked by shuffle, odd ones
+         * for the center tap. Loads for the last tap reach one sample past
+         * the window of the last output, so the last 1 to 4 outputs are
+         * loaded one by one instead, with the same operations so that
+         * results don't depend on where a call ends.
+         */
+        void decimateHalfband_sse2(const float *c, unsigned ntaps,
+                                   float center, unsigned cpos,
+                                   const float *x, float *out, size_t count)
+        {
+            const __m128 cc = _mm_set1_ps(center);
+            size_t i = 0;
+            for (; i + 4 < count; i += 4) {
+                const float *p = x + 2 * i;
+                const float *q = p + 2 * cpos;
+                __m128 acc0 = _mm_mul_ps(cc, _mm_shuffle_ps(
+                            _mm_loadu_ps(q), _mm_loadu_ps(q + 4),
+                            _MM_SHUFFLE(3, 1, 3, 1)));
+                __m128 acc1 = _mm_setzero_ps();
+                unsigned k = 0;
+                for (; k + 2 <= ntaps; k += 2) {
+                    __m128 v0 = _mm_shuffle_ps(_mm_loadu_ps(p + 2 * k),
+                                               _mm_loadu_ps(p + 2 * k + 4),
+                                               _MM_SHUFFLE(2, 0, 2, 0));
+                    __m128 v1 = _mm_shuffle_ps(_mm_loadu_ps(p + 2 * k + 2),
+                                               _mm_loadu_ps(p + 2 * k + 6),
+                                               _MM_SHUFFLE(2, 0, 2, 0));
+                    acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_set1_ps(c[k]), v0));
+                    acc1 = _mm_add_ps(acc1,
+                                      _mm_mul_ps(_mm_set1_ps(c[k + 1]), v1));
+                }
+                if (k < ntaps) {
+                    __m128 v0 = _mm_shuffle_ps(_mm_loadu_ps(p + 2 * k),
+                                               _mm_loadu_ps(p + 2 * k + 4),
+                                               _MM_SHUFFLE(2, 0, 2, 0));
+                    acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_set1_ps(c[k]), v0));
+                }
+                _mm_storeu_ps(out + i, _mm_add_ps(acc0, acc1));
+            }
+            if (i < count) {
+                unsigned n = static_cast<unsigned>(count - i);
+                const float *p = x + 2 * i;
+                __m128 acc0 = _mm_mul_ps(cc, loadEvens(p + 2 * cpos + 1, n));
+                __m128 acc1 = _mm_setzero_ps();
+                unsigned k = 0;
+                for (; k + 2 <= ntaps; k += 2) {
+                    acc0 = _mm_add_ps(acc0,
+                                      _mm_mul_ps(_mm_set1_ps(c[k]),
+                                                 loadEvens(p + 2 * k, n)));
+                    acc1 = _mm_add_ps(acc1,
+                                      _mm_mul_ps(_mm_set1_ps(c[k + 1]),
+                                                 loadEvens(p + 2 * k + 2, n)));
+                }
+                if (k < ntaps)
+                    acc0 = _mm_add_ps(acc0,
+                                      _mm_mul_ps(_mm_set1_ps(c[k]),
+                                                 loadEvens(p + 2 * k, n)));
+                float v[4];
+                _mm_storeu_ps(v, _mm_add_ps(acc0, acc1));
+                for (unsigned j = 0; j < n; ++j)
+                    out[i + j] = v[j];
+            }
+        }
+
+        void decimateHalfband64_sse2(const float *c, unsigned ntaps,
+                                     float center, unsigned cpos,
+                                     const double *x, double *out,
+                                     size_t count)
+        {
+            const __m128d cc = _mm_set1_pd(center);
+            size_t i = 0;
+            for (; i + 2 < count; i += 2) {
+                const double *p = x + 2 * i;
+                const double *q = p + 2 * cpos;
+                __m128d acc0 = _mm_mul_pd(cc,
+                                          _mm_unpackhi_pd(_mm_loadu_pd(q),
+                                                          _mm_loadu_pd(q + 2)));
+                __m128d acc1 = _mm_setzero_pd();
+                unsigned k = 0;
+                for (; k + 2 <= ntaps; k += 2) {
+                    __m128d v0 = _mm_unpacklo_pd(_mm_loadu_pd(p + 2 * k),
+                                                 _mm_loadu_pd(p + 2 * k + 2));
+                    __m128d v1 = _mm_unpacklo_pd(_mm_loadu_pd(p + 2 * k + 2),
+                                                 _mm_loadu_pd(p + 2 * k + 4));
+                    acc0 = _mm_add_pd(acc0, _mm_mul_pd(_mm_set1_pd(c[k]), v0));
+                    acc1 = _mm_add_pd(acc1,
+                                      _mm_mul_pd(_mm_set1_pd(c[k + 1]), v1));
+                }
+                if (k < ntaps) {
+                    __m128d v0 = _mm_unpacklo_pd(_mm_loadu_pd(p + 2 * k),
+                                                 _mm_loadu_pd(p + 2 * k + 2));
+                    acc0 = _mm_add_pd(acc0, _mm_mul_pd(_mm_set1_pd(c[k]), v0));
+                }
+                _mm_storeu_pd(out + i, _mm_add_pd(acc0, acc1));
+            }
+            if (i < count) {
+                unsigned n = static_cast<unsigned>(count - i);
+                const double *p = x + 2 * i;
+                __m128d acc0 =
+                    _mm_mul_pd(cc, loadEvens64(p + 2 * cpos + 1, n));
+                __m128d acc1 = _mm_setzero_pd();
+                unsigned k = 0;
+                for (; k + 2 <= ntaps; k += 2) {
+                    acc0 = _mm_add_pd(acc0,
+                                      _mm_mul_pd(_mm_set1_pd(c[k]),
+                                                 loadEvens64(p + 2 * k, n)));
+                    acc1 = _mm_add_pd(acc1,
+                                      _mm_mul_pd(_mm_set1_pd(c[k + 1]),
+                                                 loadEvens64(p + 2 * k + 2,
+                                                             n)));
+                }
+                if (k < ntaps)
+                    acc0 = _mm_add_pd(acc0,
+                                      _mm_mul_pd(_mm_set1_pd(c[k]),
+                                                 loadEvens64(p + 2 * k, n)));
+                double v[2];
+                _mm_storeu_pd(v, _mm_add_pd(acc0, acc1));
+                for (unsigned j = 0; j < n; ++j)
+                    out[i + j] = v[j];
+            }
+        }
+#endif
+    }
+
+    const Kernel &scalar()
+    {
+        static const Kernel k = {
+            "scalar", interpolate_c, convolvePlanar_c,
+            convolvePlanar64_c, decimateHalfband_c, decimateHalfband64_c
+        };
+        return k;
+    }
+
+#ifdef FIRKERNEL_X86
+    const Kernel &sse2()
+    {
+        static const Kernel k = {
+            "sse2", interpolate_sse2, convolvePlanar_sse2,
+            convolvePlanar64_sse2, decimateHalfband_sse2,
+            decimateHalfband64_sse2
+        };
+        return k;
+    }
+#else
+    const Kernel &sse2() { return scalar(); }
+    const Kernel &avx2() { return scalar(); }
+#endif
+
+    const Kernel &get()
+    {
+        if (cpuinfo::avx2())
+            return avx2();
+        else if (cpuinfo::sse2())
+            return sse2();
+        return scalar();
+    }
+}
@@ -0,0 +1,49 @@
+#ifndef FIRKERNEL_H
+#define FIRKERNEL_H
+
+#include <cstddef>
+
+/*
+ * Inner loops of the polyphase FIR, selected at runtime by CPU features.
+ * x[ch] is the plane of each channel, read from index for ntaps samples.
+ */
+namespace firkernel {
+    struct Kernel {
+        const char *name;
+        /* dst[k] = c0[k] + frac * (c1[k] - c0[k]) */
+        void (*interpolate)(const float *c0, const float *c1, float frac,
+                            float *dst, unsigned ntaps);
+        /* out[ch][offset] = sum of coefs[k] * x[ch][index + k] */
+        void (*convolvePlanar)(const float *coefs, const float * const *x,
+                               size_t index, unsigned ntaps,
+                               unsigned nchannels, float * const *out,
+                               size_t offset);
+        /* same with double samples and sums, coefficients are float */
+        void (*convolvePlanar64)(const float *coefs,
+                                 const double * const *x, size_t index,
+                                 unsigned ntaps, unsigned nchannels,
+                                 double * const *out, size_t offset);
+        /*
+         * count outputs of a decimate-by-2 halfband filter, from every
+         * other input sample: out[i] = center * x[2 * (i + cpos) + 1]
+         * + sum of coefs[k] * x[2 * (i + k)]. coefs are the nonzero taps
+         * but the center one.
+         */
+        void (*decimateHalfband)(const float *coefs, unsigned ntaps,
+                                 float center, unsigned cpos,
+                                 const float *x, float *out, size_t count);
+        void (*decimateHalfband64)(const float *coefs, unsigned ntaps,
+                                   float center, unsigned cpos,
+                                   const double *x, double *out,
+                                   size_t count);
+    };
+
+    const Kernel &scalar();
+    const Kernel &sse2();
+    const Kernel &avx2();
+
+    /* the best one available on this CPU */
+    const Kernel &get();
+}
+
+#endif
@@ -0,0 +1,385 @@
+#include <stdint.h>
+#include "firkernel.h"
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) \
+    || defined(__x86_64__)
+#include <immintrin.h>
+
+/*
+ * MSVC accepts AVX2 intrinsics anywhere (this file is built with
+ * /arch:AVX2 to avoid SSE/AVX transitions), GCC/clang need them enabled
+ * per function.
+ */
+#if defined(__GNUC__)
+#define AVX2_TARGET __attribute__((target("avx2,fma")))
+#else
+#define AVX2_TARGET
+#endif
+
+namespace firkernel {
+    namespace {
+        AVX2_TARGET
+        inline __m128 fold(__m256 v)
+        {
+            return _mm_add_ps(_mm256_castps256_ps128(v),
+                              _mm256_extractf128_ps(v, 1));
+        }
+
+        AVX2_TARGET
+        inline __m256i tailmask(unsigned n)
+        {
+            static const int table[16] = {
+                -1, -1, -1, -1, -1, -1, -1, -1, 0, 0, 0, 0, 0, 0, 0, 0
+            };
+            return _mm256_loadu_si256(
+                    reinterpret_cast<const __m256i*>(table + 8 - n));
+        }
+
+        AVX2_TARGET
+        void interpolate_avx2(const float *c0, const float *c1, float frac,
+                              float *dst, unsigned ntaps)
+        {
+            __m256 f = _mm256_set1_ps(frac);
+            unsigned k = 0;
+            for (; k + 8 <= ntaps; k += 8) {
+                __m256 a = _mm256_loadu_ps(c0 + k);
+                __m256 b = _mm256_loadu_ps(c1 + k);
+                _mm256_storeu_ps(dst + k,
+                                 _mm256_fmadd_ps(f, _mm256_sub_ps(b, a), a));
+            }
+            for (; k < ntaps; ++k)
+                dst[k] = c0[k] + frac * (c1[k] - c0[k]);
+            _mm256_zeroupper();
+        }
+
+        /*
+         * Channels in pairs, sharing the loads of coefficients, and the
+         * odd one alone. The last partial vector of taps is loaded masked,
+         * and the two sums of a pair are reduced together by hadd.
+         */
+        AVX2_TARGET
+        void convolvePlanar_avx2(const float *c, const float * const *x,
+                                 size_t index, unsigned ntaps,
+                                 unsigned nchannels, float * const *out,
+                                 size_t offset)
+        {
+            const __m256i mask = tailmask(ntaps % 8);
+            unsigned ch = 0;
+            for (; ch + 2 <= nchannels; ch += 2) {
+                const float *x0 = x[ch] + index, *x1 = x[ch + 1] + index;
+                __m256 a0 = _mm256_setzero_ps(), a1 = _mm256_setzero_ps();
+                __m256 b0 = _mm256_setzero_ps(), b1 = _mm256_setzero_ps();
+                unsigned k = 0;
+                for (; k + 16 <= ntaps; k += 16) {
+                    __m256 c0 = _mm256_loadu_ps(c + k);
+                    __m256 c1 = _mm256_loadu_ps(c + k + 8);
+                    a0 = _mm256_fmadd_ps(c0, _mm256_loadu_ps(x0 + k), a0);
+                    b0 = _mm256_fmadd_ps(c0, _mm256_loadu_ps(x1 + k), b0);
+                    a1 = _mm256_fmadd_ps(c1, _mm256_loadu_ps(x0 + k + 8), a1);
+                    b1 = _mm256_fmadd_ps(c1, _mm256_loadu_ps(x1 + k + 8), b1);
+                }
+                if (k + 8 <= ntaps) {
+                    __m256 c0 = _mm256_loadu_ps(c + k);
+                    a0 = _mm256_fmadd_ps(c0, _mm256_loadu_ps(x0 + k), a0);
+                    b0 = _mm256_fmadd_ps(c0, _mm256_loadu_ps(x1 + k), b0);
+                    k += 8;
+                }
+                if (k < ntaps) {
+                    __m256 c1 = _mm256_maskload_ps(c + k, mask);
+                    a1 = _mm256_fmadd_ps(c1, _mm256_maskload_ps(x0 + k, mask),
+                                         a1);
+                    b1 = _mm256_fmadd_ps(c1, _mm256_maskload_ps(x1 + k, mask),
+                                         b1);
+                }
+                __m128 v = fold(_mm256_hadd_ps(_mm256_add_ps(a0, a1),
+                                               _mm256_add_ps(b0, b1)));
+                v = _mm_hadd_ps(v, v);
+                out[ch][offset] = _mm_cvtss_f32(v);
+                out[ch + 1][offset] = _mm_cvtss_f32(_mm_shuffle_ps(v, v, 1));
+            }
+            if (ch < nchannels) {
+                const float *x0 = x[ch] + index;
+                __m256 a0 = _mm256_setzero_ps(), a1 = _mm256_setzero_ps();
+                __m256 a2 = _mm256_setzero_ps(), a3 = _mm256_setzero_ps();
+                unsigned k = 0;
+                for (; k + 32 <= ntaps; k += 32) {
+                    a0 = _mm256_fmadd_ps(_mm256_loadu_ps(c + k),
+                                         _mm256_loadu_ps(x0 + k), a0);
+                    a1 = _mm256_fmadd_ps(_mm256_loadu_ps(c + k + 8),
+                                         _mm256_loadu_ps(x0 + k + 8), a1);
+                    a2 = _mm256_fmadd_ps(_mm256_loadu_ps(c + k + 16),
+                                         _mm256_loadu_ps(x0 + k + 16), a2);
+                    a3 = _mm256_fmadd_ps(_mm256_loadu_ps(c + k + 24),
+                                         _mm256_loadu_ps(x0 + k + 24), a3);
+                }
+                for (; k + 8 <= ntaps; k += 8)
+                    a0 = _mm256_fmadd_ps(_mm256_loadu_ps(c + k),
+                                         _mm256_loadu_ps(x0 + k), a0);
+                if (k < ntaps)
+                    a1 = _mm256_fmadd_ps(_mm256_maskload_ps(c + k, mask),
+                                         _mm256_maskload_ps(x0 + k, mask),
+                                         a1);
+                __m128 v = fold(_mm256_add_ps(_mm256_add_ps(a0, a1),
+                                              _mm256_add_ps(a2, a3)));
+                v = _mm_hadd_ps(v, v);
+                v = _mm_hadd_ps(v, v);
+                out[ch][offset] = _mm_cvtss_f32(v);
+            }
+            _mm256_zeroupper();
+        }
+
+        /* first n of 4 doubles */
+        AVX2_TARGET
+        inline __m256i tailmask64(unsigned n)
+        {
+            static const int64_t table[8] = { -1, -1, -1, -1, 0, 0, 0, 0 };
+            return _mm256_loadu_si256(
+                    reinterpret_cast<const __m256i*>(table + 4 - n));
+        }
+
+        /* 4 coefficients, widened to double */
+        AVX2_TARGET
+        inline __m256d loadTaps64(const float *c)
+        {
+            return _mm256_cvtps_pd(_mm_loadu_ps(c));
+        }
+
+        /*
+         * Same structure as convolvePlanar_avx2, with 4 taps per vector.
+         * Coefficients are converted once for both channels of a pair.
+         */
+        AVX2_TARGET
+        void convolvePlanar64_avx2(const float *c, const double * const *x,
+                                   size_t index, unsigned ntaps,
+                                   unsigned nchannels, double * const *out,
+                                   size_t offset)
+        {
+            const __m256i mask = tailmask64(ntaps % 4);
+            const __m128i cmask = _mm256_castsi256_si128(tailmask(ntaps % 4));
+            unsigned ch = 0;
+            for (; ch + 2 <= nchannels; ch += 2) {
+                const double *x0 = x[ch] + index, *x1 = x[ch + 1] + index;
+                __m256d a0 = _mm256_setzero_pd(), a1 = _mm256_setzero_pd();
+                __m256d b0 = _mm256_setzero_pd(), b1 = _mm256_setzero_pd();
+                unsigned k = 0;
+                for (; k + 8 <= ntaps; k += 8) {
+                    __m256d c0 = loadTaps64(c + k);
+                    __m256d c1 = loadTaps64(c + k + 4);
+                    a0 = _mm256_fmadd_pd(c0, _mm256_loadu_pd(x0 + k), a0);
+                    b0 = _mm256_fmadd_pd(c0, _mm256_loadu_pd(x1 + k), b0);
+                    a1 = _mm256_fmadd_pd(c1, _mm256_loadu_pd(x0 + k + 4), a1);
+                    b1 = _mm256_fmadd_pd(c1, _mm256_loadu_pd(x1 + k + 4), b1);
+                }
+                if (k + 4 <= ntaps) {
+                    __m256d c0 = loadTaps64(c + k);
+                    a0 = _mm256_fmadd_pd(c0, _mm256_loadu_pd(x0 + k), a0);
+                    b0 = _mm256_fmadd_pd(c0, _mm256_loadu_pd(x1 + k), b0);
+                    k += 4;
+                }
+                if (k < ntaps) {
+                    __m256d c1 =
+                        _mm256_cvtps_pd(_mm_maskload_ps(c + k, cmask));
+                    a1 = _mm256_fmadd_pd(c1, _mm256_maskload_pd(x0 + k, mask),
+                                         a1);
+                    b1 = _mm256_fmadd_pd(c1, _mm256_maskload_pd(x1 + k, mask),
+                                         b1);
+                }
+                /* a01 b01 a23 b23 */
+                __m256d v = _mm256_hadd_pd(_mm256_add_pd(a0, a1),
+                                           _mm256_add_pd(b0, b1));
+                __m128d s = _mm_add_pd(_mm256_castpd256_pd128(v),
+                                       _mm256_extractf128_pd(v, 1));
+                out[ch][offset] = _mm_cvtsd_f64(s);
+                out[ch + 1][offset] = _mm_cvtsd_f64(_mm_unpackhi_pd(s, s));
+            }
+            if (ch < nchannels) {
+                const double *x0 = x[ch] + index;
+                __m256d a0 = _mm256_setzero_pd(), a1 = _mm256_setzero_pd();
+                __m256d a2 = _mm256_setzero_pd(), a3 = _mm256_setzero_pd();
+                unsigned k = 0;
+                for (; k + 16 <= ntaps; k += 16) {
+                    a0 = _mm256_fmadd_pd(loadTaps64(c + k),
+                                         _mm256_loadu_pd(x0 + k), a0);
+                    a1 = _mm256_fmadd_pd(loadTaps64(c + k + 4),
+                                         _mm256_loadu_pd(x0 + k + 4), a1);
+                    a2 = _mm256_fmadd_pd(loadTaps64(c + k + 8),
+                                         _mm256_loadu_pd(x0 + k + 8), a2);
+                    a3 = _mm256_fmadd_pd(loadTaps64(c + k + 12),
+                                         _mm256_loadu_pd(x0 + k + 12), a3);
+                }
+                for (; k + 4 <= ntaps; k += 4)
+                    a0 = _mm256_fmadd_pd(loadTaps64(c + k),
+                                         _mm256_loadu_pd(x0 + k), a0);
+                if (k < ntaps)
+                    a1 = _mm256_fmadd_pd(
+                            _mm256_cvtps_pd(_mm_maskload_ps(c + k, cmask)),
+                            _mm256_maskload_pd(x0 + k, mask), a1);
+                __m256d v = _mm256_add_pd(_mm256_add_pd(a0, a1),
+                                          _mm256_add_pd(a2, a3));
+                __m128d s = _mm_add_pd(_mm256_castpd256_pd128(v),
+                                       _mm256_extractf128_pd(v, 1));
+                s = _mm_add_sd(s, _mm_unpackhi_pd(s, s));
+                out[ch][offset] = _mm_cvtsd_f64(s);
+            }
+            _mm256_zeroupper();
+        }
+
+        /* p[0], p[2], ... p[2 * (n - 1)], zero for the other lanes */
+        AVX2_TARGET
+        inline __m256 gatherEvens(const float *p, unsigned n)
+        {
+            const __m256i index = _mm256_setr_epi32(0, 2, 4, 6, 8, 10, 12, 14);
+            return _mm256_mask_i32gather_ps(_mm256_setzero_ps(), p, index,
+                                            _mm256_castsi256_ps(tailmask(n)),
+                                            4);
+        }
+
+        AVX2_TARGET
+        inline __m256d gatherEvens64(const double *p, unsigned n)
+        {
+            const __m128i index = _mm_setr_epi32(0, 2, 4, 6);
+            return _mm256_mask_i32gather_pd(_mm256_setzero_pd(), p, index,
+                                            _mm256_castsi256_pd(
+                                                tailmask64(n)), 8);
+        }
+
+        /*
+         * Outputs are in the lanes, 8 at a time, and taps are broadcast.
+         * Even samples of two vectors (odd ones for the center tap) are
+         * picked by shuffle within 128-bit lanes, which puts the outputs
+         * in the order 0 1 4 5 2 3 6 7; one permute per block restores it.
+         * Loads for the last tap reach one sample past the window of the
+         * last output, so the last 1 to 8 outputs are gathered instead,
+         * with the same operations so that results don't depend on where
+         * a call ends.
+         */
+        AVX2_TARGET
+        void decimateHalfband_avx2(const float *c, unsigned ntaps,
+                                   float center, unsigned cpos,
+                                   const float *x, float *out, size_t count)
+        {
+            const __m256 cc = _mm256_set1_ps(center);
+            size_t i = 0;
+            for (; i + 8 < count; i += 8) {
+                const float *p = x + 2 * i;
+                const float *q = p + 2 * cpos;
+                __m256 acc0 = _mm256_mul_ps(cc, _mm256_shuffle_ps(
+                            _mm256_loadu_ps(q), _mm256_loadu_ps(q + 8),
+                            _MM_SHUFFLE(3, 1, 3, 1)));
+                __m256 acc1 = _mm256_setzero_ps();
+                unsigned k = 0;
+                for (; k + 2 <= ntaps; k += 2) {
+                    const float *pk = p + 2 * k;
+                    __m256 v0 = _mm256_shuffle_ps(_mm256_loadu_ps(pk),
+                                                  _mm256_loadu_ps(pk + 8),
+                                                  _MM_SHUFFLE(2, 0, 2, 0));
+                    __m256 v1 = _mm256_shuffle_ps(_mm256_loadu_ps(pk + 2),
+                                                  _mm256_loadu_ps(pk + 10),
+                                                  _MM_SHUFFLE(2, 0, 2, 0));
+                    acc0 = _mm256_fmadd_ps(_mm256_set1_ps(c[k]), v0, acc0);
+                    acc1 = _mm256_fmadd_ps(_mm256_set1_ps(c[k + 1]), v1, acc1);
+                }
+                if (k < ntaps) {
+                    const float *pk = p + 2 * k;
+                    __m256 v0 = _mm256_shuffle_ps(_mm256_loadu_ps(pk),
+                                                  _mm256_loadu_ps(pk + 8),
+                                                  _MM_SHUFFLE(2, 0, 2, 0));
+                    acc0 = _mm256_fmadd_ps(_mm256_set1_ps(c[k]), v0, acc0);
+                }
+                __m256d v = _mm256_castps_pd(_mm256_add_ps(acc0, acc1));
+                _mm256_storeu_ps(out + i, _mm256_castpd_ps(
+                            _mm256_permute4x64_pd(v, _MM_SHUFFLE(3, 1, 2, 0))));
+            }
+            if (i < count) {
+                unsigned n = static_cast<unsigned>(count - i);
+                const float *p = x + 2 * i;
+                __m256 acc0 =
+                    _mm256_mul_ps(cc, gatherEvens(p + 2 * cpos + 1, n));
+                __m256 acc1 = _mm256_setzero_ps();
+                unsigned k = 0;
+                for (; k + 2 <= ntaps; k += 2) {
+                    acc0 = _mm256_fmadd_ps(_mm256_set1_ps(c[k]),
+                                           gatherEvens(p + 2 * k, n), acc0);
+                    acc1 = _mm256_fmadd_ps(_mm256_set1_ps(c[k + 1]),
+                                           gatherEvens(p + 2 * k + 2, n),
+                                           acc1);
+                }
+                if (k < ntaps)
+                    acc0 = _mm256_fmadd_ps(_mm256_set1_ps(c[k]),
+                                           gatherEvens(p + 2 * k, n), acc0);
+                _mm256_maskstore_ps(out + i, tailmask(n),
+                                    _mm256_add_ps(acc0, acc1));
+            }
+            _mm256_zeroupper();
+        }
+
+        /* 4 at a time, unpack puts them in the order 0 2 1 3 */
+        AVX2_TARGET
+        void decimateHalfband64_avx2(const float *c, unsigned ntaps,
+                                     float center, unsigned cpos,
+                                     const double *x, double *out,
+                                     size_t count)
+        {
+            const __m256d cc = _mm256_set1_pd(center);
+            size_t i = 0;
+            for (; i + 4 < count; i += 4) {
+                const double *p = x + 2 * i;
+                const double *q = p + 2 * cpos;
+                __m256d acc0 = _mm256_mul_pd(cc, _mm256_unpackhi_pd(
+                            _mm256_loadu_pd(q), _mm256_loadu_pd(q + 4)));
+                __m256d acc1 = _mm256_setzero_pd();
+                unsigned k = 0;
+                for (; k + 2 <= ntaps; k += 2) {
+                    const double *pk = p + 2 * k;
+                    __m256d v0 = _mm256_unpacklo_pd(_mm256_loadu_pd(pk),
+                                                    _mm256_loadu_pd(pk + 4));
+                    __m256d v1 = _mm256_unpacklo_pd(_mm256_loadu_pd(pk + 2),
+                                                    _mm256_loadu_pd(pk + 6));
+                    acc0 = _mm256_fmadd_pd(_mm256_set1_pd(c[k]), v0, acc0);
+                    acc1 = _mm256_fmadd_pd(_mm256_set1_pd(c[k + 1]), v1, acc1);
+                }
+                if (k < ntaps) {
+                    const double *pk = p + 2 * k;
+                    __m256d v0 = _mm256_unpacklo_pd(_mm256_loadu_pd(pk),
+                                                    _mm256_loadu_pd(pk + 4));
+                    acc0 = _mm256_fmadd_pd(_mm256_set1_pd(c[k]), v0, acc0);
+                }
+                __m256d v = _mm256_add_pd(acc0, acc1);
+                _mm256_storeu_pd(out + i, _mm256_permute4x64_pd(
+                            v, _MM_SHUFFLE(3, 1, 2, 0)));
+            }
+            if (i < count) {
+                unsigned n = static_cast<unsigned>(count - i);
+                const double *p = x + 2 * i;
+                __m256d acc0 =
+                    _mm256_mul_pd(cc, gatherEvens64(p + 2 * cpos + 1, n));
+                __m256d acc1 = _mm256_setzero_pd();
+                unsigned k = 0;
+                for (; k + 2 <= ntaps; k += 2) {
+                    acc0 = _mm256_fmadd_pd(_mm256_set1_pd(c[k]),
+                                           gatherEvens64(p + 2 * k, n), acc0);
+                    acc1 = _mm256_fmadd_pd(_mm256_set1_pd(c[k + 1]),
+                                           gatherEvens64(p + 2 * k + 2, n),
+                                           acc1);
+                }
+                if (k < ntaps)
+                    acc0 = _mm256_fmadd_pd(_mm256_set1_pd(c[k]),
+                                           gatherEvens64(p + 2 * k, n), acc0);
+                _mm256_maskstore_pd(out + i, tailmask64(n),
+                                    _mm256_add_pd(acc0, acc1));
+            }
+            _mm256_zeroupper();
+        }
+    }
+
+    const Kernel &avx2()
+    {
+        static const Kernel k = {
+            "avx2", interpolate_avx2, convolvePlanar_avx2,
+            convolvePlanar64_avx2, decimateHalfband_avx2,
+            decimateHalfband64_avx2
+        };
+        return k;
+    }
+}
+
+#endif
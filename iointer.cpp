@@ -1,16 +1,16 @@
 #include <cstdio>
 #include "iointer.h"
+#include "convkernel.h"
 
-inline float quantize(double v)
+void FilterBase::seekSource(int64_t offset)
 {
-    const float anti_denormal = 1.0e-30f;
-    float x = static_cast<float>(v);
-    x += anti_denormal;
-    x -= anti_denormal;
-    return x;
+    ISeekableSource *src = dynamic_cast<ISeekableSource*>(m_src.get());
+    if (!src || !src->isSeekable())
+        throw std::runtime_error("FilterBase: source is not seekable");
+    src->seekTo(offset);
 }
 
-size_t readSamplesAsFloat(ISource *src, std::vector<uint8_t> *pivot,
+size_t readSamplesAsFloat(ISource *src, util::AlignedBuffer *pivot,
                           std::vector<float> *floatBuffer, size_t nsamples)
 {
     const AudioStreamBasicDescription &sf = src->getSampleFormat();
@@ -19,7 +19,7 @@ size_t readSamplesAsFloat(ISource *src, std::vector<uint8_t> *pivot,
     return readSamplesAsFloat(src, pivot, &(*floatBuffer)[0], nsamples);
 }
 
-size_t readSamplesAsFloat(ISource *src, std::vector<uint8_t> *pivot,
+size_t readSamplesAsFloat(ISource *src, util::AlignedBuffer *pivot,
                           float *floatBuffer, size_t nsamples)
 {
     const AudioStreamBasicDescription &sf = src->getSampleFormat();
@@ -30,26 +30,20 @@ size_t readSamplesAsFloat(ISource *src, std::vector<uint8_t> *pivot,
         return src->readSamples(floatBuffer, nsamples);
     }
 
-    if (pivot->size() < nsamples * sf.mBytesPerFrame)
-        pivot->resize(nsamples * sf.mBytesPerFrame);
-
-    uint8_t *bp = &(*pivot)[0];
-    float *fp = floatBuffer;
+    uint8_t *bp = pivot->get(nsamples * sf.mBytesPerFrame);
     nsamples = src->readSamples(bp, nsamples);
-    size_t blen = nsamples * sf.mBytesPerFrame;
+    size_t count = nsamples * sf.mChannelsPerFrame;
 
-    if (sf.mFormatFlags & kAudioFormatFlagIsFloat) {
-        double *src = reinterpret_cast<double *>(bp);
-        std::transform(src, src + (blen / 8), fp, quantize);
-    } else {
-        int *src = reinterpret_cast<int *>(bp);
-        for (size_t i = 0; i < blen / 4; ++i)
-            *fp++ = src[i] / 2147483648.0f;
-    }
+    if (sf.mFormatFlags & kAudioFormatFlagIsFloat)
+        convkernel::get().doubleToFloat(reinterpret_cast<double*>(bp),
+                                        floatBuffer, count);
+    else
+        convkernel::get().intToFloat(reinterpret_cast<int*>(bp),
+                                     floatBuffer, count);
     return nsamples;
 }
 
-size_t readSamplesAsFloat(ISource *src, std::vector<uint8_t> *pivot,
+size_t readSamplesAsFloat(ISource *src, util::AlignedBuffer *pivot,
                           std::vector<double> *doubleBuffer, size_t nsamples)
 {
     const AudioStreamBasicDescription &sf = src->getSampleFormat();
@@ -58,7 +52,7 @@ size_t readSamplesAsFloat(ISource *src, std::vector<uint8_t> *pivot,
     return readSamplesAsFloat(src, pivot, &(*doubleBuffer)[0], nsamples);
 }
 
-size_t readSamplesAsFloat(ISource *src, std::vector<uint8_t> *pivot,
+size_t readSamplesAsFloat(ISource *src, util::AlignedBuffer *pivot,
                           double *doubleBuffer, size_t nsamples)
 {
     const AudioStreamBasicDescription &sf = src->getSampleFormat();
@@ -69,22 +63,48 @@ size_t readSamplesAsFloat(ISource *src, std::vector<uint8_t> *pivot,
         return src->readSamples(doubleBuffer, nsamples);
     }
 
-    if (pivot->size() < nsamples * sf.mBytesPerFrame)
-        pivot->resize(nsamples * sf.mBytesPerFrame);
-
-    uint8_t *bp = &(*pivot)[0];
-    double *fp = doubleBuffer;
+    uint8_t *bp = pivot->get(nsamples * sf.mBytesPerFrame);
     nsamples = src->readSamples(bp, nsamples);
-    size_t blen = nsamples * sf.mBytesPerFrame;
+    size_t count = nsamples * sf.mChannelsPerFrame;
 
-    if (sf.mFormatFlags & kAudioFormatFlagIsFloat) {
-        float *src = reinterpret_cast<float*>(bp);
-        std::copy(src, src + (blen / 4), fp);
-    } else {
-        int *src = reinterpret_cast<int *>(bp);
-        for (size_t i = 0; i < blen / 4; ++i)
-            *fp++ = src[i] / 2147483648.0f;
-    }
+    if (sf.mFormatFlags & kAudioFormatFlagIsFloat)
+        convkernel::get().floatToDouble(reinterpret_cast<float*>(bp),
+                                        doubleBuffer, count);
+    else
+        convkernel::get().intToDouble(reinterpret_cast<int*>(bp),
+                                      doubleBuffer, count);
     return nsamples;
 }
 
+namespace {
+    template <typename T>
+    size_t readPlanar(ISource *src, util::AlignedBuffer *pivot,
+                      std::vector<T> *buffer, T * const *channels,
+                      size_t nsamples)
+    {
+        IPlanarSource<T> *psrc = dynamic_cast<IPlanarSource<T>*>(src);
+        if (psrc)
+            return psrc->readPlanar(channels, nsamples);
+        const unsigned nchannels = src->getSampleFormat().mChannelsPerFrame;
+        if (nchannels == 1)
+            return readSamplesAsFloat(src, pivot, channels[0], nsamples);
+        nsamples = readSamplesAsFloat(src, pivot, buffer, nsamples);
+        if (nsamples)
+            util::deinterleave(&(*buffer)[0], channels, nchannels, nsamples);
+        return nsamples;
+    }
+}
+
+size_t readSamplesAsPlanar(ISource *src, util::AlignedBuffer *pivot,
+                           std::vector<float> *buffer,
+                           float * const *channels, size_t nsamples)
+{
+    return readPlanar(src, pivot, buffer, channels, nsamples);
+}
+
+size_t readSamplesAsPlanar(ISource *src, util::AlignedBuffer *pivot,
+                           std::vector<double> *buffer,
+                           double * const *channels, size_t nsamples)
+{
+    return readPlanar(src, pivot, buffer, channels, nsamples);
+}
@@ -2,6 +2,7 @@
 #define _IOINTER_H
 
 #include <vector>
+#include <memory>
 #include <map>
 #include "CoreAudio/CoreAudioTypes.h"
 #include "util.h"
@@ -21,6 +22,28 @@ struct ISeekableSource: public ISource {
     virtual void seekTo(int64_t offset) = 0;
 };
 
+/*
+ * Optional interface of a float (or double, as T) source, which can also
+ * be read in planar layout: channels[c] receives nsamples of channel c.
+ * Both readSamples() and readPlanar() advance the same position.
+ * Found by dynamic_cast, see readSamplesAsPlanar().
+ */
+template <typename T>
+struct IPlanarSource {
+    virtual ~IPlanarSource() {}
+    virtual size_t readPlanar(T * const *channels, size_t nsamples) = 0;
+};
+
+/*
+ * Optional interface of a filter that knows its algorithmic delay: how
+ * late, in output frames, the response to an input sample is centered
+ * when input is fed as it arrives. Found by dynamic_cast.
+ */
+struct ILatencyReporter {
+    virtual ~ILatencyReporter() {}
+    virtual double latency() const = 0;
+};
+
 struct ISink {
     virtual ~ISink() {}
     virtual void writeSamples(
@@ -33,7 +56,11 @@ struct ITagParser {
     virtual const std::vector<chapters::entry_t> *getChapters() const = 0;
 };
 
-class FilterBase: public ISource {
+/*
+ * Filters are not seekable unless they override isSeekable() and seekTo().
+ * seekTo() takes a position in the output of the filter.
+ */
+class FilterBase: public ISeekableSource {
     std::shared_ptr<ISource> m_src;
 public:
     FilterBase() {}
@@ -55,6 +82,14 @@ public:
     {
         return m_src->readSamples(buffer, nsamples);
     }
+    bool isSeekable() { return false; }
+    void seekTo(int64_t)
+    {
+        throw std::runtime_error("FilterBase: seek is not supported");
+    }
+protected:
+    /* seek the source, if it can */
+    void seekSource(int64_t offset);
 };
 
 /*
@@ -91,18 +126,36 @@ public:
     }
 };
 
-size_t readSamplesAsFloat(ISource *src, std::vector<uint8_t> *pivot,
+/*
+ * Reads 32bit int or float/double samples into float/double samples,
+ * through pivot when a conversion is needed. pivot can be null if the
+ * source is already in the format of the buffer.
+ */
+size_t readSamplesAsFloat(ISource *src, util::AlignedBuffer *pivot,
                           std::vector<float> *floatBuffer, size_t nsamples);
 
-size_t readSamplesAsFloat(ISource *src, std::vector<uint8_t> *pivot,
+size_t readSamplesAsFloat(ISource *src, util::AlignedBuffer *pivot,
                           float *floatBuffer, size_t nsamples);
 
-size_t readSamplesAsFloat(ISource *src, std::vector<uint8_t> *pivot,
+size_t readSamplesAsFloat(ISource *src, util::AlignedBuffer *pivot,
                           std::vector<double> *floatBuffer, size_t nsamples);
 
-size_t readSamplesAsFloat(ISource *src, std::vector<uint8_t> *pivot,
+size_t readSamplesAsFloat(ISource *src, util::AlignedBuffer *pivot,
                           double *floatBuffer, size_t nsamples);
 
+/*
+ * Reads float/double samples in planar layout: by readPlanar() if the
+ * source is an IPlanarSource of the type, otherwise by
+ * readSamplesAsFloat() into buffer and deinterleaving.
+ */
+size_t readSamplesAsPlanar(ISource *src, util::AlignedBuffer *pivot,
+                           std::vector<float> *buffer,
+                           float * const *channels, size_t nsamples);
+
+size_t readSamplesAsPlanar(ISource *src, util::AlignedBuffer *pivot,
+                           std::vector<double> *buffer,
+                           double * const *channels, size_t nsamples);
+
 namespace chapters {
     struct Track {
         std::wstring name;
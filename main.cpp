@@ -1,9 +1,58 @@
+#include <clocale>
+#include <ctime>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#ifndef _WIN32
+#include <dirent.h>
+#include <strings.h>
+#endif
 #include "wavsource.h"
 #include "wavsink.h"
+#ifdef _WIN32
 #include "MSResampler.h"
+#endif
+#include "PolyphaseResampler.h"
+#include "ParallelResampler.h"
+#include "ReadAheadSource.h"
+#include "WriteBehindSink.h"
+#include "filtercache.h"
+#include "packkernel.h"
+#include "cpuinfo.h"
 #include "Quantizer.h"
+#include "chanmap.h"
 #include "wgetopt.h"
 
+static
+uint32_t tickCount()
+{
+#ifdef _WIN32
+    return GetTickCount();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+#endif
+}
+
+static
+std::shared_ptr<FILE> openFile(const std::wstring &path, const wchar_t *mode)
+{
+#ifdef _WIN32
+    return win32::fopen(path, mode);
+#else
+    struct noop { static void call(FILE*) {} };
+    if (path == L"-")
+        return std::shared_ptr<FILE>(std::wcschr(mode, L'r') ? stdin : stdout,
+                                     noop::call);
+    std::string spath = strutil::w2m(path);
+    FILE *fp = std::fopen(spath.c_str(), strutil::w2m(mode).c_str());
+    if (!fp)
+        util::throw_crt_error(spath);
+    return std::shared_ptr<FILE>(fp, std::fclose);
+#endif
+}
+
 static
 void secondsToHMS(double seconds, int *h, int *m, int *s, int *millis)
 {
@@ -25,11 +74,57 @@ std::wstring formatSeconds(double seconds)
 }
 
 class Timer {
-    DWORD m_ticks;
+    uint32_t m_ticks;
 public:
-    Timer() { m_ticks = GetTickCount(); };
+    Timer() { m_ticks = tickCount(); };
     double ellapsed() {
-        return (static_cast<double>(GetTickCount()) - m_ticks) / 1000.0;
+        return (static_cast<double>(tickCount()) - m_ticks) / 1000.0;
+    }
+};
+
+/*
+ * Time taken by each readSamples() call in streaming mode, counted in a
+ * fixed histogram so that recording costs no allocation: bins are 2%
+ * wide from 0.1us up, and percentiles are the upper edge of their bin.
+ * The maximum is exact.
+ */
+class CallLatency {
+    enum { kBins = 1024 };
+    uint32_t m_bins[kBins];
+    uint32_t m_count;
+    double m_max;
+    std::chrono::steady_clock::time_point m_start;
+public:
+    CallLatency(): m_count(0), m_max(0.0)
+    {
+        std::memset(m_bins, 0, sizeof m_bins);
+    }
+    void start() { m_start = std::chrono::steady_clock::now(); }
+    void stop()
+    {
+        std::chrono::duration<double, std::micro> d =
+            std::chrono::steady_clock::now() - m_start;
+        double usecs = d.count();
+        int bin = usecs > 0.1 ?
+            static_cast<int>(std::log(usecs / 0.1) / std::log(1.02)) + 1 : 0;
+        ++m_bins[bin < kBins ? bin : kBins - 1];
+        ++m_count;
+        if (usecs > m_max)
+            m_max = usecs;
+    }
+    /* p in 0.0-1.0; max at 1.0 */
+    double percentile(double p) const
+    {
+        if (!m_count || p >= 1.0)
+            return m_max;
+        uint32_t n = static_cast<uint32_t>(p * (m_count - 1) + .5);
+        uint32_t seen = 0;
+        int bin = 0;
+        for (; bin < kBins - 1; ++bin)
+            if ((seen += m_bins[bin]) > n)
+                break;
+        double edge = 0.1 * std::pow(1.02, bin);
+        return edge < m_max ? edge : m_max;
     }
 };
 
@@ -40,12 +135,12 @@ class PeriodicDisplay {
 public:
     PeriodicDisplay(uint32_t interval)
         : m_interval(interval),
-          m_last_tick(GetTickCount())
+          m_last_tick(tickCount())
     {
     }
     void put(const std::wstring &message) {
         m_message = message;
-        uint32_t tick = GetTickCount();
+        uint32_t tick = tickCount();
         if (tick - m_last_tick > m_interval) {
             flush();
             m_last_tick = tick;
@@ -80,10 +175,10 @@ public:
         double eta = ellapsed * (m_total / fcurrent - 1);
         double speed = ellapsed ? seconds/ellapsed : 0.0;
         if (m_total == ~0ULL)
-            m_disp.put(strutil::format(L"\r%s (%.1fx)   ",
+            m_disp.put(strutil::format(L"\r%ls (%.1fx)   ",
                 formatSeconds(seconds).c_str(), speed));
         else
-            m_disp.put(strutil::format(L"\r[%.1f%%] %s/%s (%.1fx), ETA %s  ",
+            m_disp.put(strutil::format(L"\r[%.1f%%] %ls/%ls (%.1fx), ETA %ls  ",
                 percent, formatSeconds(seconds).c_str(), m_tstamp.c_str(),
                 speed, formatSeconds(eta).c_str()));
     }
@@ -92,50 +187,216 @@ public:
         m_disp.flush();
         fputwc('\n', stderr);
         double ellapsed = m_timer.ellapsed();
-        fwprintf(stderr, L"%lld/%lld samples processed in %s\n",
+        fwprintf(stderr, L"%lld/%lld samples processed in %ls\n",
                  current, m_total, formatSeconds(ellapsed).c_str());
     }
 };
 
+struct Options {
+    int rate;
+    int quality;
+    double bandwidth;
+    int bits;
+    /* resample in double, for -b 64 or more processing downstream */
+    bool float64;
+    /* minimum phase filters, less delay but not aligned with the input */
+    bool minphase;
+    bool native;
+    unsigned threads;
+    unsigned segments;
+    unsigned readahead;
+    unsigned writebehind;
+    /* streaming: frames pulled per call, 0 for the default */
+    unsigned block;
+    FlushPolicy flush;
+    uint32_t seed;
+    NoiseShaper::Type shaping;
+    /* output channel mask of the mixer, 0 if none or unknown */
+    uint32_t layout;
+    /* explicit mixing matrix, otherwise derived from layout */
+    std::vector<std::vector<double> > matrix;
+    bool quiet;
+};
+
+/* the mixer in front of the resampler, or source as is */
+static
+std::shared_ptr<ISeekableSource>
+mixChannels(const std::shared_ptr<ISeekableSource> &source,
+            const Options &opts)
+{
+    if (!opts.layout && opts.matrix.empty())
+        return source;
+    std::vector<std::vector<double> > matrix = opts.matrix;
+    if (matrix.empty()) {
+        std::vector<uint32_t> channels;
+        const std::vector<uint32_t> *layout = source->getChannels();
+        if (layout)
+            channels = *layout;
+        else {
+            unsigned n = source->getSampleFormat().mChannelsPerFrame;
+            if (n > 8)
+                throw std::runtime_error("channel layout of the input is "
+                                         "unknown, give the matrix by -M");
+            chanmap::getChannels(chanmap::defaultChannelMask(n), &channels);
+        }
+        chanmap::getDownmixMatrix(channels, opts.layout, &matrix);
+    }
+    return std::make_shared<ChannelMixer>(source, matrix, opts.layout);
+}
+
+/* returns the number of frames written */
 static
-void process(const std::shared_ptr<FILE> &ifp,
-             const std::shared_ptr<FILE> &ofp, int rate, int quality,
-             double bandwidth, int bits)
+uint64_t process(const std::wstring &ifilename, const std::wstring &ofilename,
+                 const Options &opts)
 {
+    std::shared_ptr<FILE> ifp = openFile(ifilename, L"rb");
     std::shared_ptr<WaveSource> source(std::make_shared<WaveSource>(ifp));
 
-    const std::vector<uint32_t> *channels = source->getChannels();
-    uint32_t chanmask = 0;
-    if (channels) {
-        for (size_t i = 0; i < channels->size(); ++i)
-            chanmask |= (1 << (channels->at(i) - 1));
+    std::shared_ptr<ISource> filter;
+    std::shared_ptr<ReadAheadSource> readahead;
+    if (opts.native && opts.segments > 1 && !opts.block &&
+        ifilename != L"-" && source->isSeekable()) {
+        /* each segment in flight reads the input by its own handle */
+        std::vector<std::shared_ptr<ISeekableSource> >
+            sources(1, mixChannels(source, opts));
+        for (unsigned i = 1; i < opts.segments; ++i)
+            sources.push_back(mixChannels(std::make_shared<WaveSource>(
+                                            openFile(ifilename, L"rb")),
+                                          opts));
+        filter = std::make_shared<SegmentedResampler>(sources, opts.rate,
+                                                      opts.quality,
+                                                      opts.bandwidth,
+                                                      opts.float64,
+                                                      opts.minphase);
+    } else {
+        std::shared_ptr<ISeekableSource> input = source;
+        if (opts.readahead) {
+            readahead = std::make_shared<ReadAheadSource>(source,
+                                                          opts.readahead);
+            input = readahead;
+        }
+        input = mixChannels(input, opts);
+        if (opts.native) {
+            std::shared_ptr<ThreadPool> pool;
+            if (opts.threads > 1)
+                pool = std::make_shared<ThreadPool>(opts.threads);
+            filter = createNativeResampler(input, opts.rate, opts.quality,
+                                           opts.bandwidth, pool,
+                                           opts.float64, opts.minphase);
+        }
+#ifdef _WIN32
+        else {
+            std::shared_ptr<IDMODSPEngine> engine =
+                std::make_shared<MSResampler>(input, opts.rate, opts.quality,
+                                              opts.bandwidth);
+            filter = std::make_shared<DMODSPProcessor>(input, engine);
+        }
+#endif
     }
+    /* the DMO doesn't tell */
+    ILatencyReporter *delay = dynamic_cast<ILatencyReporter*>(filter.get());
+#ifdef _WIN32
+    DMODSPProcessor *dmo = dynamic_cast<DMODSPProcessor*>(filter.get());
+#endif
+
+    /* 32 and 64 are float, converted only if the resampler differs */
+    bool is_float = opts.bits >= 32;
+    unsigned bits = filter->getSampleFormat().mBitsPerChannel;
+    if (!is_float || bits != static_cast<unsigned>(opts.bits))
+        filter = std::make_shared<Quantizer>(filter, opts.bits, false,
+                                             is_float, opts.seed,
+                                             opts.shaping);
 
-    std::shared_ptr<IDMODSPEngine> engine =
-        std::make_shared<MSResampler>(source, rate, quality, bandwidth);
-    std::shared_ptr<ISource> filter =
-        std::make_shared<DMODSPProcessor>(source, engine);
-    if (bits != 32)
-        filter = std::make_shared<Quantizer>(filter, bits, false, bits == 32);
+    const std::vector<uint32_t> *channels = filter->getChannels();
+    uint32_t chanmask = channels ? chanmap::getChannelMask(*channels) : 0;
 
+    std::shared_ptr<FILE> ofp = openFile(ofilename, L"wb");
     std::shared_ptr<WaveSink> sink =
         std::make_shared<WaveSink>(ofp.get(), filter->length(),
                                    filter->getSampleFormat(),
-                                   chanmask);
+                                   chanmask, opts.flush);
+    std::shared_ptr<ISink> output = sink;
+    std::shared_ptr<WriteBehindSink> writebehind;
+    if (opts.writebehind) {
+        writebehind = std::make_shared<WriteBehindSink>(sink,
+                                                        opts.writebehind);
+        output = writebehind;
+    }
 
-    const size_t pull_packets = 4096;
+    const size_t pull_packets = opts.block ? opts.block : 4096;
     AudioStreamBasicDescription asbd = filter->getSampleFormat();
     std::vector<uint8_t> buffer(pull_packets * asbd.mBytesPerFrame);
 
     size_t ns;
-    Progress progress(source->length(), source->getSampleFormat().mSampleRate);
-    while ((ns = filter->readSamples(&buffer[0], pull_packets)) > 0) {
-        sink->writeSamples(&buffer[0], ns * asbd.mBytesPerFrame, ns);
-        progress.update(source->getPosition());
+    std::shared_ptr<Progress> progress;
+    if (!opts.quiet)
+        progress = std::make_shared<Progress>(filter->length(), opts.rate);
+    CallLatency calls;
+#ifdef _WIN32
+    /* media buffers of the DMO, once grown by the first call */
+    size_t warmed_up = 0;
+    bool warm = false;
+#endif
+    for (;;) {
+        if (opts.block)
+            calls.start();
+        ns = filter->readSamples(&buffer[0], pull_packets);
+        if (!ns)
+            break;
+        if (opts.block)
+            calls.stop();
+#ifdef _WIN32
+        if (dmo && !warm) {
+            warmed_up = dmo->allocationCount();
+            warm = true;
+        }
+#endif
+        output->writeSamples(&buffer[0], ns * asbd.mBytesPerFrame, ns);
+        if (progress)
+            progress->update(filter->getPosition());
     }
-    progress.finish(source->getPosition());
+    if (writebehind)
+        writebehind->finish();
+    sink->finishWrite();
+    if (progress)
+        progress->finish(filter->getPosition());
+    if (progress && readahead)
+        std::fwprintf(stderr, L"read-ahead stalls: %llu waiting for input, "
+                      L"%llu waiting for processing\n",
+                      static_cast<unsigned long long>(
+                          readahead->consumerStalls()),
+                      static_cast<unsigned long long>(
+                          readahead->producerStalls()));
+    if (progress && writebehind)
+        std::fwprintf(stderr, L"write-behind stalls: %llu\n",
+                      static_cast<unsigned long long>(writebehind->stalls()));
+    if (progress && opts.block) {
+        double ms = 1000.0 / asbd.mSampleRate;
+        std::fwprintf(stderr, L"block: %u frames (%.2fms), ",
+                      opts.block, opts.block * ms);
+        if (delay)
+            std::fwprintf(stderr, L"algorithmic delay: %.1f frames "
+                          L"(%.2fms)\n",
+                          delay->latency(), delay->latency() * ms);
+        else
+            std::fwprintf(stderr, L"algorithmic delay: unknown\n");
+        std::fwprintf(stderr, L"per-call latency: max %.1fus, "
+                      L"99.9%% %.1fus, 99%% %.1fus, median %.1fus\n",
+                      calls.percentile(1.0), calls.percentile(0.999),
+                      calls.percentile(0.99), calls.percentile(0.5));
+#ifdef _WIN32
+        if (dmo && warm)
+            std::fwprintf(stderr, L"DMO buffer allocations: %u, "
+                          L"%u after the first call\n",
+                          static_cast<unsigned>(dmo->allocationCount()),
+                          static_cast<unsigned>(dmo->allocationCount() -
+                                                warmed_up));
+#endif
+    }
+    return filter->getPosition();
 }
 
+#ifdef _WIN32
 struct COMInitializer {
     COMInitializer()
     {
@@ -146,56 +407,473 @@ struct COMInitializer {
         CoUninitialize();
     }
 };
+#endif
+
+struct BatchItem {
+    std::wstring ifilename;
+    std::wstring ofilename;
+    uint64_t frames;
+    double seconds;
+    std::wstring error;
+};
+
+static
+bool isDirectory(const std::wstring &path)
+{
+#ifdef _WIN32
+    return PathIsDirectoryW(path.c_str()) != FALSE;
+#else
+    struct stat stb;
+    return stat(strutil::w2m(path).c_str(), &stb) == 0 &&
+           S_ISDIR(stb.st_mode);
+#endif
+}
+
+/* *.wav files in the directory, sorted by name */
+static
+std::vector<std::wstring> listWaveFiles(const std::wstring &dir)
+{
+    std::vector<std::wstring> files;
+#ifdef _WIN32
+    WIN32_FIND_DATAW fd;
+    HANDLE h = FindFirstFileW(win32::PathCombineX(dir, L"*.wav").c_str(),
+                              &fd);
+    if (h == INVALID_HANDLE_VALUE) {
+        DWORD error = GetLastError();
+        if (error != ERROR_FILE_NOT_FOUND)
+            win32::throw_error(dir, error);
+        return files;
+    }
+    do {
+        if (!(fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+            files.push_back(win32::PathCombineX(dir, fd.cFileName));
+    } while (FindNextFileW(h, &fd));
+    FindClose(h);
+#else
+    std::string sdir = strutil::w2m(dir);
+    DIR *dp = opendir(sdir.c_str());
+    if (!dp)
+        util::throw_crt_error(sdir);
+    struct dirent *ent;
+    while ((ent = readdir(dp)) != 0) {
+        size_t len = std::strlen(ent->d_name);
+        if (len > 4 && !strcasecmp(ent->d_name + len - 4, ".wav"))
+            files.push_back(dir + L"/" + strutil::m2w(ent->d_name));
+    }
+    closedir(dp);
+#endif
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+/*
+ * Output file name for the input: "{dir}" is replaced with the directory
+ * of the input ("." if none), "{name}" with its file name without the
+ * extension.
+ */
+static
+std::wstring expandTemplate(const std::wstring &tmpl,
+                            const std::wstring &ifilename)
+{
+    size_t sep = ifilename.find_last_of(L"/\\");
+    std::wstring dir = sep == std::wstring::npos
+        ? L"." : ifilename.substr(0, sep == 0 ? 1 : sep);
+    std::wstring name = ifilename.substr(sep == std::wstring::npos
+                                         ? 0 : sep + 1);
+    size_t dot = name.rfind(L'.');
+    if (dot != std::wstring::npos && dot > 0)
+        name = name.substr(0, dot);
+
+    std::wstring result;
+    for (size_t i = 0; i < tmpl.size(); ) {
+        if (tmpl.compare(i, 5, L"{dir}") == 0) {
+            result += dir;
+            i += 5;
+        } else if (tmpl.compare(i, 6, L"{name}") == 0) {
+            result += name;
+            i += 6;
+        } else
+            result.push_back(tmpl[i++]);
+    }
+    return result;
+}
+
+/*
+ * List file has one input per line, optionally followed by a TAB and
+ * the output file name. Empty lines and lines starting with # are
+ * ignored. Text is in UTF-8.
+ */
+static
+void readBatchList(const std::wstring &listfile, const std::wstring &tmpl,
+                   std::vector<BatchItem> *items)
+{
+    std::shared_ptr<FILE> fp = openFile(listfile, L"r");
+    std::string line;
+    char buf[4096];
+    while (std::fgets(buf, sizeof buf, fp.get())) {
+        line += buf;
+        if (line.empty() || line[line.size() - 1] != '\n') {
+            if (!std::feof(fp.get()))
+                continue;
+        }
+        while (line.size() && (line[line.size() - 1] == '\n' ||
+                               line[line.size() - 1] == '\r'))
+            line.erase(line.size() - 1);
+        std::wstring wline = strutil::us2w(line);
+        line.clear();
+        if (wline.empty() || wline[0] == L'#')
+            continue;
+        BatchItem item = { wline, L"", 0, 0.0 };
+        size_t tab = wline.find(L'\t');
+        if (tab != std::wstring::npos) {
+            item.ifilename = wline.substr(0, tab);
+            item.ofilename = wline.substr(tab + 1);
+        } else if (tmpl.size())
+            item.ofilename = expandTemplate(tmpl, wline);
+        else
+            throw std::runtime_error("no output file name for " +
+                                     strutil::w2us(wline) +
+                                     " in the list, and no -o given");
+        items->push_back(item);
+    }
+}
+
+static
+void runBatchItem(BatchItem *item, const Options &opts)
+{
+#ifdef _WIN32
+    COMInitializer __com__;
+#endif
+    Timer timer;
+    try {
+        item->frames = process(item->ifilename, item->ofilename, opts);
+    } catch (const std::exception &e) {
+        item->error = strutil::us2w(e.what());
+    }
+    item->seconds = timer.ellapsed();
+}
+
+/*
+ * Files are processed concurrently by jobs threads. Filter tables are
+ * shared among them through filtercache.
+ */
+static
+int processBatch(std::vector<BatchItem> &items, const Options &opts,
+                 unsigned jobs)
+{
+    Timer timer;
+    {
+        ThreadPool pool(std::min<unsigned>(jobs, items.size()));
+        pool.run(items.size(), [&](size_t i) {
+            runBatchItem(&items[i], opts);
+        });
+    }
+    size_t nfailed = 0;
+    for (size_t i = 0; i < items.size(); ++i) {
+        const BatchItem &item = items[i];
+        if (item.error.size()) {
+            ++nfailed;
+            std::fwprintf(stderr, L"FAILED %8.3fs  %ls: %ls\n",
+                          item.seconds, item.ifilename.c_str(),
+                          item.error.c_str());
+        } else
+            std::fwprintf(stderr,
+                          L"ok     %8.3fs  %ls -> %ls (%llu samples)\n",
+                          item.seconds, item.ifilename.c_str(),
+                          item.ofilename.c_str(),
+                          static_cast<unsigned long long>(item.frames));
+    }
+    std::fwprintf(stderr, L"%u files, %u failed, in %ls\n",
+                  static_cast<unsigned>(items.size()),
+                  static_cast<unsigned>(nfailed),
+                  formatSeconds(timer.ellapsed()).c_str());
+    return nfailed ? 2 : 0;
+}
+
+/* "every", "end", "<bytes>" or "<msecs>ms" */
+static
+bool parseFlushPolicy(const wchar_t *s, FlushPolicy *policy)
+{
+    unsigned long long value;
+    wchar_t unit[3] = { 0 };
+    if (!std::wcscmp(s, L"every"))
+        *policy = FlushPolicy(FlushPolicy::kEveryWrite, 0);
+    else if (!std::wcscmp(s, L"end"))
+        *policy = FlushPolicy(FlushPolicy::kAtEnd, 0);
+    else if (std::swscanf(s, L"%llu%2ls", &value, unit) < 1)
+        return false;
+    else if (!unit[0] && value > 0)
+        *policy = FlushPolicy(FlushPolicy::kBytes, value);
+    else if (!std::wcscmp(unit, L"ms"))
+        *policy = FlushPolicy(FlushPolicy::kInterval, value);
+    else
+        return false;
+    return true;
+}
+
+/* "mono", "stereo" or a channel mask like 0x3f */
+static
+bool parseLayout(const wchar_t *s, uint32_t *layout)
+{
+    wchar_t *end;
+    if (!std::wcscmp(s, L"mono"))
+        *layout = 0x4;
+    else if (!std::wcscmp(s, L"stereo"))
+        *layout = 0x3;
+    else if ((*layout = std::wcstoul(s, &end, 0)) == 0 || *end)
+        return false;
+    return true;
+}
+
+/* rows (output channels) separated by "/", coefficients by "," */
+static
+bool parseMatrix(const wchar_t *s, std::vector<std::vector<double> > *matrix)
+{
+    std::vector<std::vector<double> > result(1);
+    for (;;) {
+        wchar_t *end;
+        result.back().push_back(std::wcstod(s, &end));
+        if (end == s)
+            return false;
+        if (!*end)
+            break;
+        if (*end == L'/')
+            result.push_back(std::vector<double>());
+        else if (*end != L',')
+            return false;
+        s = end + 1;
+    }
+    matrix->swap(result);
+    return true;
+}
+
+/* throughput of each packkernel implementation this CPU can run */
+static void benchPackKernels()
+{
+    const size_t count = 1 << 20;
+    std::vector<uint32_t> wide(count);
+    std::vector<uint8_t> narrow(count * 3);
+    for (size_t i = 0; i < count; ++i)
+        wide[i] = static_cast<uint32_t>(i * 2654435761U);
+
+    std::vector<const packkernel::Kernel *> kernels;
+    kernels.push_back(&packkernel::scalar());
+    if (cpuinfo::ssse3())
+        kernels.push_back(&packkernel::ssse3());
+    if (cpuinfo::avx2())
+        kernels.push_back(&packkernel::avx2());
+
+    for (int unpack = 0; unpack < 2; ++unpack) {
+        for (unsigned width = 1; width <= 3; ++width) {
+            for (size_t k = 0; k < kernels.size(); ++k) {
+                packkernel::Convert fn = unpack
+                    ? kernels[k]->unpack[width - 1]
+                    : kernels[k]->pack[width - 1];
+                Timer timer;
+                unsigned rounds = 0;
+                double seconds;
+                do {
+                    if (unpack)
+                        fn(&narrow[0], &wide[0], count);
+                    else
+                        fn(&wide[0], &narrow[0], count);
+                    ++rounds;
+                } while ((seconds = timer.ellapsed()) < 0.25);
+                std::fwprintf(stderr, L"%ls %u->%u %-8hs %8.1f Msamples/s\n",
+                              unpack ? L"unpack" : L"pack  ",
+                              unpack ? width : 4, unpack ? 4 : width,
+                              kernels[k]->name,
+                              count * rounds / seconds / 1e6);
+            }
+        }
+    }
+}
 
 static void usage()
 {
     std::fputws(
 L"usage: MSResampler -r RATE [OPTIONS] INFILE OUTFILE\n"
+L"       MSResampler -r RATE [OPTIONS] -o TEMPLATE INFILE|DIRECTORY...\n"
+L"       MSResampler -r RATE [OPTIONS] -L LISTFILE [-o TEMPLATE]\n"
 L"\n"
 L"\"-\" as INFILE means stdin\n"
 L"\"-\" as OUTFILE means stdout\n"
 L"[Options]\n"
 L"-r <n>     sample rate in Hz (required)\n"
 L"-q <n>     quality: 1-60 (default 60)\n"
-L"-w <float> lowpass bandwidth: 0.0-1.0 (default 0.95)\n"
-L"-b <n>     output bitdepth: 2-32 (default 32)\n"
+L"-w <float> lowpass bandwidth: over 0.0, up to 1.0 (default 0.95)\n"
+L"-b <n>     output bitdepth: 2-32, or 64 for 64bit float (default 32,\n"
+L"           which is 32bit float)\n"
+L"-d <n>     seed of dither noise (default 0)\n"
+L"-m <mask>  mix channels into the layout before resampling: \"mono\",\n"
+L"           \"stereo\" or channel mask (e.g. 0x3f for 5.1). Without -M,\n"
+L"           ITU downmix (-3dB for center and surround, LFE dropped)\n"
+L"-M <mat>   mixing matrix, \"/\" between rows (output channels) and\n"
+L"           \",\" between coefficients (input channels),\n"
+L"           e.g. \"1,0,.707,0,.707,0/0,1,.707,0,0,.707\"\n"
+L"-N <type>  noise shaping: \"none\" (default), \"hp2\" (2nd order\n"
+L"           highpass), \"fw\" (F-weighted 9-tap for 44.1/48kHz, hp2 at\n"
+L"           other rates)\n"
+#ifdef _WIN32
+L"-n         use built-in polyphase resampler instead of Windows DMO\n"
+#endif
+L"-D         resample in 64bit float (built-in resampler only, implied by\n"
+L"           -b 64)\n"
+L"-P         minimum phase filters (built-in resampler only): less delay\n"
+L"           and no pre-ringing, but output is late by the group delay\n"
+L"           instead of aligned with the input\n"
+L"-c <dir>   keep filter tables of built-in resampler in <dir>\n"
+L"-t <n>     threads for multichannel input (built-in resampler only,\n"
+L"           default 1, 0 means number of CPUs)\n"
+L"-s <n>     resample n time segments of a seekable input concurrently\n"
+L"           (built-in resampler only, default 1, 0 means number of CPUs)\n"
+L"-a <n>     read input ahead by n blocks on another thread (default 0)\n"
+L"-W <n>     write output behind by n blocks on another thread (default 0)\n"
+L"-F <when>  flush non-seekable output (pipe): \"every\" write,\n"
+L"           every <n> bytes, every <n>ms, or at \"end\" (default 1048576)\n"
+L"-S <n>     streaming: pull exactly n frames per call, without -s, and\n"
+L"           report the algorithmic delay and the worst per-call latency.\n"
+L"           Use with -F every for a pipe\n"
+L"\n"
+L"[Batch mode]\n"
+L"-o <tmpl>  output file name; {dir} and {name} are replaced with the\n"
+L"           directory and the name without extension of the input.\n"
+L"           DIRECTORY means *.wav in it\n"
+L"-L <file>  read inputs from the file, one per line; optionally followed\n"
+L"           by TAB and the output name\n"
+L"-j <n>     number of files processed at once (default: number of CPUs)\n"
+L"\n"
+L"-B         benchmark sample packing kernels on this CPU and exit\n"
     , stderr);
     std::exit(1);
 }
 
 int wmain(int argc, wchar_t **argv)
 {
+#ifdef _WIN32
     _setmode(0, _O_BINARY);
     _setmode(2, _O_U8TEXT);
+    bool native = false;
+#else
+    bool native = true;
+#endif
     std::setbuf(stderr, 0);
 
     int ch;
-    int rate = 0, quality = 60, bits = 32;
-    double bandwidth = 0.95;
-    while ((ch = getopt::getopt(argc, argv, L"r:q:w:b:")) != -1) {
+    Options opts = { 0, 60, 0.95, 32, false, false, native, 1, 1, 0, 0, 0,
+                     FlushPolicy(),
+                     0, NoiseShaper::kNone, 0,
+                     std::vector<std::vector<double> >(), false };
+    int threads;
+    unsigned jobs = ThreadPool::defaultSize();
+    std::wstring tmpl, listfile;
+    const wchar_t *optstring = L"r:q:w:b:d:m:M:N:nDPc:t:s:a:W:S:F:o:L:j:B";
+    while ((ch = getopt::getopt(argc, argv, optstring)) != -1) {
         switch (ch) {
         case 'r':
-            if (std::swscanf(getopt::optarg, L"%d", &rate) != 1 || rate <= 0)
+            if (std::swscanf(getopt::optarg, L"%d", &opts.rate) != 1 ||
+                opts.rate <= 0)
                 usage();
             break;
         case 'q':
-            if (std::swscanf(getopt::optarg, L"%d", &quality) != 1)
+            if (std::swscanf(getopt::optarg, L"%d", &opts.quality) != 1)
                 usage();
-            if (quality < 1 || quality > 60)
+            if (opts.quality < 1 || opts.quality > 60)
                 usage();
             break;
         case 'w':
-            if (std::swscanf(getopt::optarg, L"%lf", &bandwidth) != 1)
+            if (std::swscanf(getopt::optarg, L"%lf", &opts.bandwidth) != 1)
                 usage();
-            if (bandwidth < 0.0 || bandwidth > 1.0)
+            if (opts.bandwidth <= 0.0 || opts.bandwidth > 1.0)
                 usage();
             break;
         case 'b':
-            if (std::swscanf(getopt::optarg, L"%d", &bits) != 1)
+            if (std::swscanf(getopt::optarg, L"%d", &opts.bits) != 1)
                 usage();
-            if (bits < 2 || bits > 32)
+            if ((opts.bits < 2 || opts.bits > 32) && opts.bits != 64)
+                usage();
+            if (opts.bits == 64)
+                opts.float64 = true;
+            break;
+        case 'd':
+            if (std::swscanf(getopt::optarg, L"%u", &opts.seed) != 1)
                 usage();
             break;
+        case 'm':
+            if (!parseLayout(getopt::optarg, &opts.layout))
+                usage();
+            break;
+        case 'M':
+            if (!parseMatrix(getopt::optarg, &opts.matrix))
+                usage();
+            break;
+        case 'N':
+            if (!std::wcscmp(getopt::optarg, L"none"))
+                opts.shaping = NoiseShaper::kNone;
+            else if (!std::wcscmp(getopt::optarg, L"hp2"))
+                opts.shaping = NoiseShaper::kHighpass2;
+            else if (!std::wcscmp(getopt::optarg, L"fw"))
+                opts.shaping = NoiseShaper::kFWeighted;
+            else
+                usage();
+            break;
+        case 'n':
+            opts.native = true;
+            break;
+        case 'D':
+            opts.float64 = true;
+            break;
+        case 'P':
+            opts.minphase = true;
+            break;
+        case 'c':
+            filtercache::setDirectory(getopt::optarg);
+            break;
+        case 't':
+        case 's':
+            if (std::swscanf(getopt::optarg, L"%d", &threads) != 1)
+                usage();
+            if (threads < 0)
+                usage();
+            if (threads == 0)
+                threads = ThreadPool::defaultSize();
+            if (ch == 't')
+                opts.threads = threads;
+            else
+                opts.segments = threads;
+            break;
+        case 'a':
+            if (std::swscanf(getopt::optarg, L"%u", &opts.readahead) != 1)
+                usage();
+            break;
+        case 'W':
+            if (std::swscanf(getopt::optarg, L"%u", &opts.writebehind) != 1)
+                usage();
+            break;
+        case 'S':
+            if (std::swscanf(getopt::optarg, L"%u", &opts.block) != 1 ||
+                !opts.block)
+                usage();
+            break;
+        case 'F':
+            if (!parseFlushPolicy(getopt::optarg, &opts.flush))
+                usage();
+            break;
+        case 'o':
+            tmpl = getopt::optarg;
+            break;
+        case 'L':
+            listfile = getopt::optarg;
+            break;
+        case 'j':
+            if (std::swscanf(getopt::optarg, L"%u", &jobs) != 1)
+                usage();
+            if (!jobs)
+                jobs = ThreadPool::defaultSize();
+            break;
+        case 'B':
+            benchPackKernels();
+            return 0;
         default:
             usage();
         }
@@ -203,15 +881,57 @@ int wmain(int argc, wchar_t **argv)
     argc -= getopt::optind;
     argv += getopt::optind;
     try {
-        if (argc < 2 || !rate)
+        if (!opts.rate)
             usage();
-        std::shared_ptr<FILE> ifp = win32::fopen(argv[0], L"rb");
-        std::shared_ptr<FILE> ofp = win32::fopen(argv[1], L"wb");
+#ifdef _WIN32
         COMInitializer __com__;
-        process(ifp, ofp, rate, quality, bandwidth, bits);
+#endif
+        if (tmpl.size() || listfile.size()) {
+            std::vector<BatchItem> items;
+            if (listfile.size())
+                readBatchList(listfile, tmpl, &items);
+            else if (!argc)
+                usage();
+            if (argc && tmpl.empty())
+                usage();
+            for (int i = 0; i < argc; ++i) {
+                std::vector<std::wstring> files;
+                if (isDirectory(argv[i]))
+                    files = listWaveFiles(argv[i]);
+                else
+                    files.push_back(argv[i]);
+                for (size_t j = 0; j < files.size(); ++j) {
+                    BatchItem item = {
+                        files[j], expandTemplate(tmpl, files[j]), 0, 0.0
+                    };
+                    items.push_back(item);
+                }
+            }
+            opts.quiet = true;
+            return processBatch(items, opts, jobs);
+        }
+        if (argc < 2)
+            usage();
+        process(argv[0], argv[1], opts);
         return 0;
     } catch (const std::exception &e) {
-        std::fwprintf(stderr, L"ERROR: %s\n", strutil::us2w(e.what()));
+        std::fwprintf(stderr, L"ERROR: %ls\n",
+                      strutil::us2w(e.what()).c_str());
         return 2;
     }
 }
+
+#ifndef _WIN32
+int main(int argc, char **argv)
+{
+    std::setlocale(LC_CTYPE, "");
+    std::vector<std::wstring> args;
+    for (int i = 0; i < argc; ++i)
+        args.push_back(strutil::m2w(argv[i]));
+    std::vector<wchar_t *> wargv;
+    for (int i = 0; i < argc; ++i)
+        wargv.push_back(&args[i][0]);
+    wargv.push_back(0);
+    return wmain(argc, &wargv[0]);
+}
+#endif
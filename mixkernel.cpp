@@ -0,0 +1,37 @@
+#include "mixkernel.h"
+#include "cpuinfo.h"
+
+namespace mixkernel {
+    namespace {
+        void mix_c(const float *src, float *dst, size_t nframes,
+                   const float *coefs, unsigned nin, unsigned nout)
+        {
+            for (size_t n = 0; n < nframes; ++n, src += nin, dst += nout) {
+                for (unsigned o = 0; o < nout; ++o) {
+                    const float *cp = coefs + (o / 8 * nin) * 8 + o % 8;
+                    float acc = 0.0f;
+                    for (unsigned i = 0; i < nin; ++i)
+                        acc += cp[i * 8] * src[i];
+                    dst[o] = acc;
+                }
+            }
+        }
+    }
+
+    const Kernel &scalar()
+    {
+        static const Kernel k = { "scalar", mix_c };
+        return k;
+    }
+
+#if !defined(_M_IX86) && !defined(_M_X64) && !defined(__i386__) \
+    && !defined(__x86_64__)
+    const Kernel &avx2() { return scalar(); }
+#endif
+
+    const Kernel &get()
+    {
+        static const Kernel &k = cpuinfo::avx2() ? avx2() : scalar();
+        return k;
+    }
+}
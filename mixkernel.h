@@ -0,0 +1,31 @@
+#ifndef MIXKERNEL_H
+#define MIXKERNEL_H
+
+#include <cstddef>
+
+/*
+ * Channel matrix multiply for ChannelMixer, selected at runtime by CPU
+ * features like firkernel.
+ *
+ * coefs holds the matrix by columns, in chunks of 8 output channels:
+ * coefs[(o / 8 * nin + i) * 8 + o % 8] is the gain from input channel i
+ * to output channel o, and the unused end of the last chunk is zero.
+ * src and dst are interleaved and must not overlap.
+ */
+namespace mixkernel {
+    typedef void (*Mix)(const float *src, float *dst, size_t nframes,
+                        const float *coefs, unsigned nin, unsigned nout);
+
+    struct Kernel {
+        const char *name;
+        Mix mix;
+    };
+
+    const Kernel &scalar();
+    const Kernel &avx2();
+
+    /* the best one available on this CPU */
+    const Kernel &get();
+}
+
+#endif
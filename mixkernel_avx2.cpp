@@ -0,0 +1,56 @@
+#include "mixkernel.h"
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) \
+    || defined(__x86_64__)
+#include <immintrin.h>
+
+/* see firkernel_avx2.cpp */
+#if defined(__GNUC__)
+#define AVX2_TARGET __attribute__((target("avx2")))
+#else
+#define AVX2_TARGET
+#endif
+
+namespace mixkernel {
+    namespace {
+        /*
+         * A chunk of 8 output channels of a frame at once: the input
+         * samples are broadcast and multiplied by the columns, added in
+         * the same order as the scalar version (no FMA), so the results
+         * are bit-identical.
+         * Stores of a partial chunk run into the following frames, and are
+         * overwritten by them; the last frames, where such a store would
+         * pass the end of dst, are left to the scalar version.
+         */
+        AVX2_TARGET
+        void mix_avx2(const float *src, float *dst, size_t nframes,
+                      const float *coefs, unsigned nin, unsigned nout)
+        {
+            const unsigned nchunks = (nout + 7) / 8;
+            const size_t end = nframes * nout;
+            size_t n = 0;
+            for (; n * nout + nchunks * 8 <= end; ++n) {
+                const float *x = src + n * nin;
+                float *y = dst + n * nout;
+                const float *cp = coefs;
+                for (unsigned c = 0; c < nchunks; ++c) {
+                    __m256 acc = _mm256_setzero_ps();
+                    for (unsigned i = 0; i < nin; ++i, cp += 8)
+                        acc = _mm256_add_ps(acc,
+                                _mm256_mul_ps(_mm256_loadu_ps(cp),
+                                              _mm256_broadcast_ss(x + i)));
+                    _mm256_storeu_ps(y + c * 8, acc);
+                }
+            }
+            scalar().mix(src + n * nin, dst + n * nout, nframes - n,
+                         coefs, nin, nout);
+        }
+    }
+
+    const Kernel &avx2()
+    {
+        static const Kernel k = { "avx2", mix_avx2 };
+        return k;
+    }
+}
+
+#endif
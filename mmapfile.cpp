@@ -0,0 +1,60 @@
+#include "mmapfile.h"
+#include "util.h"
+#ifdef _WIN32
+#include "win32util.h"
+#else
+#include <sys/mman.h>
+#endif
+
+MappedFile::MappedFile(int fd)
+    : m_view(0), m_size(0)
+{
+#ifdef _WIN32
+    int64_t size = _filelengthi64(fd);
+    if (size < 0)
+        util::throw_crt_error("_filelengthi64()");
+    m_size = size;
+    if (!m_size)
+        return;
+    HANDLE fh = reinterpret_cast<HANDLE>(_get_osfhandle(fd));
+    HANDLE hMap = CreateFileMappingW(fh, 0, PAGE_READONLY, 0, 0, 0);
+    if (!hMap)
+        win32::throw_error("CreateFileMapping", GetLastError());
+    m_view = MapViewOfFile(hMap, FILE_MAP_READ, 0, 0, 0);
+    DWORD err = GetLastError();
+    CloseHandle(hMap);
+    if (!m_view)
+        win32::throw_error("MapViewOfFile", err);
+#else
+    struct stat stb = { 0 };
+    if (fstat(fd, &stb))
+        util::throw_crt_error("fstat()");
+    m_size = stb.st_size;
+    if (!m_size)
+        return;
+    void *view = mmap(0, m_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (view == MAP_FAILED)
+        util::throw_crt_error("mmap()");
+    m_view = view;
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+    if (!m_view)
+        return;
+#ifdef _WIN32
+    UnmapViewOfFile(m_view);
+#else
+    munmap(m_view, m_size);
+#endif
+}
+
+void MappedFile::adviseSequential()
+{
+#ifndef _WIN32
+    /* only a hint, failure doesn't matter */
+    if (m_view)
+        madvise(m_view, m_size, MADV_SEQUENTIAL);
+#endif
+}
@@ -0,0 +1,25 @@
+#ifndef MMAPFILE_H
+#define MMAPFILE_H
+
+#include <stdint.h>
+
+/*
+ * Read-only mapping of a whole file given by a descriptor.
+ * The descriptor can be closed once the mapping is made.
+ */
+class MappedFile {
+    void *m_view;
+    uint64_t m_size;
+public:
+    explicit MappedFile(int fd);
+    ~MappedFile();
+    const uint8_t *data() const { return static_cast<uint8_t*>(m_view); }
+    uint64_t size() const { return m_size; }
+    /* hint that the mapping will be read from the beginning to the end */
+    void adviseSequential();
+private:
+    MappedFile(const MappedFile&);
+    MappedFile &operator=(const MappedFile&);
+};
+
+#endif
@@ -0,0 +1,242 @@
+#include <stdint.h>
+#include "packkernel.h"
+#include "cpuinfo.h"
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) \
+    || defined(__x86_64__)
+#include <tmmintrin.h>
+#define PACKKERNEL_X86 1
+#endif
+
+#if defined(__GNUC__)
+#define SSSE3_TARGET __attribute__((target("ssse3")))
+#else
+#define SSSE3_TARGET
+#endif
+
+namespace packkernel {
+    namespace {
+        template <typename Y>
+        void pack_c(const void *input, void *output, size_t count)
+        {
+            const uint32_t *src = static_cast<const uint32_t*>(input);
+            Y *dst = static_cast<Y*>(output);
+            const int shifts = (4 - sizeof(Y)) * 8;
+            for (size_t i = 0; i < count; ++i)
+                dst[i] = static_cast<Y>(src[i] >> shifts);
+        }
+
+        void pack24_c(const void *input, void *output, size_t count)
+        {
+            const uint8_t *src = static_cast<const uint8_t*>(input);
+            uint8_t *dst = static_cast<uint8_t*>(output);
+            for (size_t i = 0; i < count; ++i) {
+                dst[0] = src[1];
+                dst[1] = src[2];
+                dst[2] = src[3];
+                src += 4;
+                dst += 3;
+            }
+        }
+
+        template <typename X>
+        void unpack_c(const void *input, void *output, size_t count)
+        {
+            const X *src = static_cast<const X*>(input);
+            uint32_t *dst = static_cast<uint32_t*>(output);
+            const int shifts = (4 - sizeof(X)) * 8;
+            for (size_t i = 0; i < count; ++i)
+                dst[i] = static_cast<uint32_t>(src[i]) << shifts;
+        }
+
+        void unpack24_c(const void *input, void *output, size_t count)
+        {
+            const uint8_t *src = static_cast<const uint8_t*>(input);
+            uint8_t *dst = static_cast<uint8_t*>(output);
+            for (size_t i = 0; i < count; ++i) {
+                dst[0] = 0;
+                dst[1] = src[0];
+                dst[2] = src[1];
+                dst[3] = src[2];
+                src += 3;
+                dst += 4;
+            }
+        }
+
+#ifdef PACKKERNEL_X86
+        /*
+         * pshufb picks the upper bytes of 4 samples into the low bytes of
+         * the register. Every block is loaded before anything is stored,
+         * and never stores more than it packs, so in place is fine.
+         */
+        SSSE3_TARGET
+        void pack8_ssse3(const void *input, void *output, size_t count)
+        {
+            const uint8_t *src = static_cast<const uint8_t*>(input);
+            uint8_t *dst = static_cast<uint8_t*>(output);
+            const __m128i shuf = _mm_setr_epi8(3, 7, 11, 15, -1, -1, -1, -1,
+                                               -1, -1, -1, -1, -1, -1, -1, -1);
+            size_t i = 0;
+            for (; i + 16 <= count; i += 16, src += 64, dst += 16) {
+                __m128i v[4];
+                for (int k = 0; k < 4; ++k)
+                    v[k] = _mm_shuffle_epi8(_mm_loadu_si128(
+                            reinterpret_cast<const __m128i*>(src + 16 * k)),
+                            shuf);
+                __m128i lo = _mm_unpacklo_epi32(v[0], v[1]);
+                __m128i hi = _mm_unpacklo_epi32(v[2], v[3]);
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst),
+                                 _mm_unpacklo_epi64(lo, hi));
+            }
+            pack_c<uint8_t>(src, dst, count - i);
+        }
+
+        SSSE3_TARGET
+        void pack16_ssse3(const void *input, void *output, size_t count)
+        {
+            const uint8_t *src = static_cast<const uint8_t*>(input);
+            uint8_t *dst = static_cast<uint8_t*>(output);
+            const __m128i shuf = _mm_setr_epi8(2, 3, 6, 7, 10, 11, 14, 15,
+                                               -1, -1, -1, -1, -1, -1, -1, -1);
+            size_t i = 0;
+            for (; i + 8 <= count; i += 8, src += 32, dst += 16) {
+                __m128i a =
+                    _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+                __m128i b =
+                    _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 16));
+                a = _mm_shuffle_epi8(a, shuf);
+                b = _mm_shuffle_epi8(b, shuf);
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst),
+                                 _mm_unpacklo_epi64(a, b));
+            }
+            pack_c<uint16_t>(src, dst, count - i);
+        }
+
+        SSSE3_TARGET
+        void pack24_ssse3(const void *input, void *output, size_t count)
+        {
+            const uint8_t *src = static_cast<const uint8_t*>(input);
+            uint8_t *dst = static_cast<uint8_t*>(output);
+            const __m128i shuf = _mm_setr_epi8(1, 2, 3, 5, 6, 7, 9, 10, 11,
+                                               13, 14, 15, -1, -1, -1, -1);
+            size_t i = 0;
+            for (; i + 8 <= count; i += 8, src += 32, dst += 24) {
+                __m128i a =
+                    _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+                __m128i b =
+                    _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 16));
+                a = _mm_shuffle_epi8(a, shuf);
+                b = _mm_shuffle_epi8(b, shuf);
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst),
+                                 _mm_or_si128(a, _mm_slli_si128(b, 12)));
+                _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + 16),
+                                 _mm_srli_si128(b, 4));
+            }
+            pack24_c(src, dst, count - i);
+        }
+
+        SSSE3_TARGET
+        void unpack8_ssse3(const void *input, void *output, size_t count)
+        {
+            const uint8_t *src = static_cast<const uint8_t*>(input);
+            uint8_t *dst = static_cast<uint8_t*>(output);
+            size_t i = 0;
+            for (; i + 16 <= count; i += 16, src += 16, dst += 64) {
+                __m128i v =
+                    _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+                for (int k = 0; k < 4; ++k) {
+                    const char b = static_cast<char>(4 * k);
+                    __m128i shuf = _mm_setr_epi8(-1, -1, -1, b,
+                                                 -1, -1, -1, b + 1,
+                                                 -1, -1, -1, b + 2,
+                                                 -1, -1, -1, b + 3);
+                    _mm_storeu_si128(
+                        reinterpret_cast<__m128i*>(dst + 16 * k),
+                        _mm_shuffle_epi8(v, shuf));
+                }
+            }
+            unpack_c<uint8_t>(src, dst, count - i);
+        }
+
+        SSSE3_TARGET
+        void unpack16_ssse3(const void *input, void *output, size_t count)
+        {
+            const uint8_t *src = static_cast<const uint8_t*>(input);
+            uint8_t *dst = static_cast<uint8_t*>(output);
+            const __m128i shuf0 = _mm_setr_epi8(-1, -1, 0, 1, -1, -1, 2, 3,
+                                                -1, -1, 4, 5, -1, -1, 6, 7);
+            const __m128i shuf1 = _mm_setr_epi8(-1, -1, 8, 9, -1, -1, 10, 11,
+                                                -1, -1, 12, 13, -1, -1, 14, 15);
+            size_t i = 0;
+            for (; i + 8 <= count; i += 8, src += 16, dst += 32) {
+                __m128i v =
+                    _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst),
+                                 _mm_shuffle_epi8(v, shuf0));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 16),
+                                 _mm_shuffle_epi8(v, shuf1));
+            }
+            unpack_c<uint16_t>(src, dst, count - i);
+        }
+
+        /*
+         * 8 samples (24 bytes) per loop. The second load starts at byte 8
+         * instead of 12 so that nothing past the input is read.
+         */
+        SSSE3_TARGET
+        void unpack24_ssse3(const void *input, void *output, size_t count)
+        {
+            const uint8_t *src = static_cast<const uint8_t*>(input);
+            uint8_t *dst = static_cast<uint8_t*>(output);
+            const __m128i shuf0 = _mm_setr_epi8(-1, 0, 1, 2, -1, 3, 4, 5,
+                                                -1, 6, 7, 8, -1, 9, 10, 11);
+            const __m128i shuf1 = _mm_setr_epi8(-1, 4, 5, 6, -1, 7, 8, 9,
+                                                -1, 10, 11, 12, -1, 13, 14, 15);
+            size_t i = 0;
+            for (; i + 8 <= count; i += 8, src += 24, dst += 32) {
+                __m128i a =
+                    _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+                __m128i b =
+                    _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 8));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst),
+                                 _mm_shuffle_epi8(a, shuf0));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 16),
+                                 _mm_shuffle_epi8(b, shuf1));
+            }
+            unpack24_c(src, dst, count - i);
+        }
+#endif
+    }
+
+    const Kernel &scalar()
+    {
+        static const Kernel k = {
+            "scalar",
+            { pack_c<uint8_t>, pack_c<uint16_t>, pack24_c },
+            { unpack_c<uint8_t>, unpack_c<uint16_t>, unpack24_c }
+        };
+        return k;
+    }
+
+#ifdef PACKKERNEL_X86
+    const Kernel &ssse3()
+    {
+        static const Kernel k = {
+            "ssse3",
+            { pack8_ssse3, pack16_ssse3, pack24_ssse3 },
+            { unpack8_ssse3, unpack16_ssse3, unpack24_ssse3 }
+        };
+        return k;
+    }
+#else
+    const Kernel &ssse3() { return scalar(); }
+    const Kernel &avx2() { return scalar(); }
+#endif
+
+    const Kernel &get()
+    {
+        static const Kernel &k = cpuinfo::avx2() ? avx2()
+                               : cpuinfo::ssse3() ? ssse3()
+                               : scalar();
+        return k;
+    }
+}
@@ -0,0 +1,32 @@
+#ifndef PACKKERNEL_H
+#define PACKKERNEL_H
+
+#include <cstddef>
+
+/*
+ * Conversion between 32bit samples and narrower ones, keeping the most
+ * significant bytes, selected at runtime by CPU features like firkernel.
+ * Functions are indexed by the narrow width in bytes - 1.
+ *
+ * pack can run in place (output == input), unpack can not.
+ */
+namespace packkernel {
+    typedef void (*Convert)(const void *input, void *output, size_t count);
+
+    struct Kernel {
+        const char *name;
+        /* 32bit -> 8, 16, 24bit */
+        Convert pack[3];
+        /* 8, 16, 24bit -> 32bit, lower bytes are zero */
+        Convert unpack[3];
+    };
+
+    const Kernel &scalar();
+    const Kernel &ssse3();
+    const Kernel &avx2();
+
+    /* the best one available on this CPU */
+    const Kernel &get();
+}
+
+#endif
@@ -0,0 +1,167 @@
+#include <stdint.h>
+#include "packkernel.h"
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) \
+    || defined(__x86_64__)
+#include <immintrin.h>
+
+/* see firkernel_avx2.cpp */
+#if defined(__GNUC__)
+#define AVX2_TARGET __attribute__((target("avx2")))
+#else
+#define AVX2_TARGET
+#endif
+
+namespace packkernel {
+    namespace {
+        /*
+         * vpshufb shuffles within each 128bit lane, so the packed bytes of
+         * a lane are put together by a cross-lane vpermd/vpermq after it.
+         * Loads of a block are done before its stores, and stores never
+         * pass the end of what the block packs: in place is fine.
+         */
+        AVX2_TARGET
+        void pack8_avx2(const void *input, void *output, size_t count)
+        {
+            const uint8_t *src = static_cast<const uint8_t*>(input);
+            uint8_t *dst = static_cast<uint8_t*>(output);
+            const __m256i shuf = _mm256_setr_epi8(
+                3, 7, 11, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                3, 7, 11, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+            const __m256i perm = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+            size_t i = 0;
+            for (; i + 32 <= count; i += 32, src += 128, dst += 32) {
+                __m256i v[4];
+                for (int k = 0; k < 4; ++k)
+                    v[k] = _mm256_shuffle_epi8(_mm256_loadu_si256(
+                            reinterpret_cast<const __m256i*>(src + 32 * k)),
+                            shuf);
+                __m256i lo = _mm256_unpacklo_epi32(v[0], v[1]);
+                __m256i hi = _mm256_unpacklo_epi32(v[2], v[3]);
+                __m256i r = _mm256_unpacklo_epi64(lo, hi);
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst),
+                                    _mm256_permutevar8x32_epi32(r, perm));
+            }
+            ssse3().pack[0](src, dst, count - i);
+        }
+
+        AVX2_TARGET
+        void pack16_avx2(const void *input, void *output, size_t count)
+        {
+            const uint8_t *src = static_cast<const uint8_t*>(input);
+            uint8_t *dst = static_cast<uint8_t*>(output);
+            const __m256i shuf = _mm256_setr_epi8(
+                2, 3, 6, 7, 10, 11, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1,
+                2, 3, 6, 7, 10, 11, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1);
+            size_t i = 0;
+            for (; i + 16 <= count; i += 16, src += 64, dst += 32) {
+                __m256i a = _mm256_loadu_si256(
+                    reinterpret_cast<const __m256i*>(src));
+                __m256i b = _mm256_loadu_si256(
+                    reinterpret_cast<const __m256i*>(src + 32));
+                a = _mm256_shuffle_epi8(a, shuf);
+                b = _mm256_shuffle_epi8(b, shuf);
+                __m256i r = _mm256_unpacklo_epi64(a, b);
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst),
+                                    _mm256_permute4x64_epi64(r, 0xd8));
+            }
+            ssse3().pack[1](src, dst, count - i);
+        }
+
+        AVX2_TARGET
+        void pack24_avx2(const void *input, void *output, size_t count)
+        {
+            const uint8_t *src = static_cast<const uint8_t*>(input);
+            uint8_t *dst = static_cast<uint8_t*>(output);
+            const __m256i shuf = _mm256_setr_epi8(
+                1, 2, 3, 5, 6, 7, 9, 10, 11, 13, 14, 15, -1, -1, -1, -1,
+                1, 2, 3, 5, 6, 7, 9, 10, 11, 13, 14, 15, -1, -1, -1, -1);
+            const __m256i perm = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7);
+            size_t i = 0;
+            for (; i + 16 <= count; i += 16, src += 64, dst += 48) {
+                __m256i a = _mm256_loadu_si256(
+                    reinterpret_cast<const __m256i*>(src));
+                __m256i b = _mm256_loadu_si256(
+                    reinterpret_cast<const __m256i*>(src + 32));
+                /* 24 packed bytes at the bottom of each */
+                a = _mm256_permutevar8x32_epi32(
+                        _mm256_shuffle_epi8(a, shuf), perm);
+                b = _mm256_permutevar8x32_epi32(
+                        _mm256_shuffle_epi8(b, shuf), perm);
+                /* the garbage top of a is overwritten by b */
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst), a);
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 24),
+                                 _mm256_castsi256_si128(b));
+                _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + 40),
+                                 _mm256_extracti128_si256(b, 1));
+            }
+            ssse3().pack[2](src, dst, count - i);
+        }
+
+        AVX2_TARGET
+        void unpack8_avx2(const void *input, void *output, size_t count)
+        {
+            const uint8_t *src = static_cast<const uint8_t*>(input);
+            uint8_t *dst = static_cast<uint8_t*>(output);
+            size_t i = 0;
+            for (; i + 8 <= count; i += 8, src += 8, dst += 32) {
+                __m256i v = _mm256_cvtepu8_epi32(_mm_loadl_epi64(
+                        reinterpret_cast<const __m128i*>(src)));
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst),
+                                    _mm256_slli_epi32(v, 24));
+            }
+            ssse3().unpack[0](src, dst, count - i);
+        }
+
+        AVX2_TARGET
+        void unpack16_avx2(const void *input, void *output, size_t count)
+        {
+            const uint8_t *src = static_cast<const uint8_t*>(input);
+            uint8_t *dst = static_cast<uint8_t*>(output);
+            size_t i = 0;
+            for (; i + 8 <= count; i += 8, src += 16, dst += 32) {
+                __m256i v = _mm256_cvtepu16_epi32(_mm_loadu_si128(
+                        reinterpret_cast<const __m128i*>(src)));
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst),
+                                    _mm256_slli_epi32(v, 16));
+            }
+            ssse3().unpack[1](src, dst, count - i);
+        }
+
+        /*
+         * 8 samples (24 bytes) per lane pair; the upper lane is loaded
+         * from byte 8, so that nothing past the input is read.
+         */
+        AVX2_TARGET
+        void unpack24_avx2(const void *input, void *output, size_t count)
+        {
+            const uint8_t *src = static_cast<const uint8_t*>(input);
+            uint8_t *dst = static_cast<uint8_t*>(output);
+            const __m256i shuf = _mm256_setr_epi8(
+                -1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11,
+                -1, 4, 5, 6, -1, 7, 8, 9, -1, 10, 11, 12, -1, 13, 14, 15);
+            size_t i = 0;
+            for (; i + 8 <= count; i += 8, src += 24, dst += 32) {
+                __m256i v = _mm256_inserti128_si256(
+                    _mm256_castsi128_si256(_mm_loadu_si128(
+                        reinterpret_cast<const __m128i*>(src))),
+                    _mm_loadu_si128(
+                        reinterpret_cast<const __m128i*>(src + 8)), 1);
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst),
+                                    _mm256_shuffle_epi8(v, shuf));
+            }
+            ssse3().unpack[2](src, dst, count - i);
+        }
+    }
+
+    const Kernel &avx2()
+    {
+        static const Kernel k = {
+            "avx2",
+            { pack8_avx2, pack16_avx2, pack24_avx2 },
+            { unpack8_avx2, unpack16_avx2, unpack24_avx2 }
+        };
+        return k;
+    }
+}
+
+#endif
@@ -0,0 +1,57 @@
+#include "shufflekernel.h"
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) \
+    || defined(__x86_64__)
+#include <tmmintrin.h>
+
+#if defined(__GNUC__)
+#define SSSE3_TARGET __attribute__((target("ssse3")))
+#else
+#define SSSE3_TARGET
+#endif
+
+namespace shufflekernel {
+    SSSE3_TARGET
+    void shuffleBytes_ssse3(const uint8_t mask[16], void *data,
+                            size_t stride, size_t count)
+    {
+        const __m128i m =
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(mask));
+        uint8_t *bp = static_cast<uint8_t*>(data);
+        for (size_t g = 0; g < count; ++g, bp += stride) {
+            __m128i *p = reinterpret_cast<__m128i*>(bp);
+            _mm_storeu_si128(p, _mm_shuffle_epi8(_mm_loadu_si128(p), m));
+        }
+    }
+}
+
+#else
+#include <cstring>
+
+namespace shufflekernel {
+    /* never selected, cpuinfo is always false; only to satisfy the linker */
+    void shuffleBytes_ssse3(const uint8_t mask[16], void *data,
+                            size_t stride, size_t count)
+    {
+        uint8_t *bp = static_cast<uint8_t*>(data);
+        uint8_t tmp[16];
+        for (size_t g = 0; g < count; ++g, bp += stride) {
+            std::memcpy(tmp, bp, 16);
+            for (unsigned i = 0; i < 16; ++i)
+                bp[i] = tmp[mask[i]];
+        }
+    }
+
+    void permuteDwords_avx2(const uint32_t index[8], void *data,
+                            size_t stride, size_t count)
+    {
+        uint8_t *bp = static_cast<uint8_t*>(data);
+        uint32_t tmp[8];
+        for (size_t g = 0; g < count; ++g, bp += stride) {
+            std::memcpy(tmp, bp, 32);
+            for (unsigned i = 0; i < 8; ++i)
+                std::memcpy(bp + 4 * i, &tmp[index[i]], 4);
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef SHUFFLEKERNEL_H
+#define SHUFFLEKERNEL_H
+
+#include <cstddef>
+#include <stdint.h>
+
+/*
+ * In place permutation of a window of bytes (dwords) repeated at a fixed
+ * stride, for ChannelMapper.
+ *
+ * Window g covers data + g * stride up to 16 bytes (8 dwords), and is
+ * loaded, permuted and stored back in turn. stride can be smaller than the
+ * window, provided that the part of the window past stride is mapped to
+ * itself: it is then written back unchanged before the next window is
+ * loaded.
+ *
+ * Callers check cpuinfo before using them.
+ */
+namespace shufflekernel {
+    /* pshufb by mask (no zeroing entries) */
+    void shuffleBytes_ssse3(const uint8_t mask[16], void *data,
+                            size_t stride, size_t count);
+
+    /* vpermd by index */
+    void permuteDwords_avx2(const uint32_t index[8], void *data,
+                            size_t stride, size_t count);
+}
+
+#endif
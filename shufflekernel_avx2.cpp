@@ -0,0 +1,29 @@
+#include "shufflekernel.h"
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) \
+    || defined(__x86_64__)
+#include <immintrin.h>
+
+/* see firkernel_avx2.cpp */
+#if defined(__GNUC__)
+#define AVX2_TARGET __attribute__((target("avx2")))
+#else
+#define AVX2_TARGET
+#endif
+
+namespace shufflekernel {
+    AVX2_TARGET
+    void permuteDwords_avx2(const uint32_t index[8], void *data,
+                            size_t stride, size_t count)
+    {
+        const __m256i idx =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(index));
+        uint8_t *bp = static_cast<uint8_t*>(data);
+        for (size_t g = 0; g < count; ++g, bp += stride) {
+            __m256i *p = reinterpret_cast<__m256i*>(bp);
+            _mm256_storeu_si256(p, _mm256_permutevar8x32_epi32(
+                    _mm256_loadu_si256(p), idx));
+        }
+    }
+}
+
+#endif
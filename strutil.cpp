@@ -121,5 +121,26 @@ namespace strutil {
 
         return std::wstring(&buffer[0], &buffer[rc]);
     }
+#else
+    std::wstring format(const wchar_t *fmt, ...)
+    {
+        va_list args;
+        std::vector<wchar_t> buffer(128);
+
+        for (;;) {
+            va_start(args, fmt);
+            int rc = vswprintf(&buffer[0], buffer.size(), fmt, args);
+            va_end(args);
+            if (rc >= 0 && rc < static_cast<int>(buffer.size()))
+                return std::wstring(&buffer[0], &buffer[rc]);
+            /*
+             * vswprintf() doesn't tell the required size, and also fails
+             * on encoding errors. Give up at some point.
+             */
+            if (buffer.size() >= 0x100000)
+                return L"";
+            buffer.resize(buffer.size() * 2);
+        }
+    }
 #endif
 }
@@ -1,6 +1,7 @@
 #ifndef STRUTIL_HPP_INCLUDED
 #define STRUTIL_HPP_INCLUDED
 
+#include <cstring>
 #include <cwchar>
 #include <string>
 #include <vector>
@@ -1,7 +1,11 @@
 #include <cstdio>
 #include <cstdarg>
 #include <vector>
+#if !defined(_MSC_VER) && !defined(__MINGW32__)
+#include <unistd.h>
+#endif
 #include "util.h"
+#include "packkernel.h"
 
 namespace util {
     void bswap16buffer(uint8_t *buffer, size_t size)
@@ -52,84 +56,45 @@ namespace util {
         }
     }
 
-    template <typename X, typename Y>
-    void packXtoY(void *data, size_t *size)
+    void pack(const void *input, void *output, size_t *size, unsigned width,
+              unsigned new_width)
     {
-        const X *src = static_cast<X*>(data);
-        Y *dst = static_cast<Y*>(data);
-        const int count = static_cast<int>(*size / sizeof(X));
-        const int shifts = (sizeof(X) - sizeof(Y)) * 8;
-        
-        for (int i = 0; i < count; ++i)
-            dst[i] = static_cast<Y>(src[i] >> shifts);
-        *size = count * sizeof(Y);
-    }
-
-    void pack(void *data, size_t *size, unsigned width, unsigned new_width)
-    {
-        if (width == new_width)
-            return;
-        else if (width == 4 && new_width == 1)
-            packXtoY<uint32_t, uint8_t>(data, size);
-        else if (width == 4 && new_width == 2)
-            packXtoY<uint32_t, uint16_t>(data, size);
-        else if (width == 4 && new_width == 3) {
-            const uint8_t *src = static_cast<uint8_t*>(data);
-            uint8_t *dst = static_cast<uint8_t*>(data);
-            const size_t count = *size / 4;
-            for (size_t i = 0; i < count; ++i) {
-                dst[0] = src[1];
-                dst[1] = src[2];
-                dst[2] = src[3];
-                src += 4;
-                dst += 3;
-            }
-            *size = count * 3;
+        if (width == new_width) {
+            if (input != output)
+                std::memmove(output, input, *size);
+        } else if (width == 4 && new_width >= 1 && new_width <= 3) {
+            size_t count = *size / 4;
+            packkernel::get().pack[new_width - 1](input, output, count);
+            *size = count * new_width;
         } else {
             throw std::runtime_error("util::pack(): BUG");
         }
     }
 
-    template <typename X, typename Y>
-    void unpackXtoY(const void *input, void *output, size_t *size)
-    {
-        const X *src = static_cast<const X*>(input);
-        Y *dst = static_cast<Y*>(output);
-        const int count = static_cast<int>(*size / sizeof(X));
-        const int shifts = (sizeof(Y) - sizeof(X)) * 8;
-        
-        for (int i = 0; i < count; ++i)
-            dst[i] = static_cast<Y>(src[i] << shifts);
-        *size = count * sizeof(Y);
-    }
-
     void unpack(const void *input, void *output, size_t *size, unsigned width,
                 unsigned new_width)
     {
-        if (width == new_width)
+        if (width == new_width) {
             std::memcpy(output, input, *size);
-        else if (width == 1 && new_width == 4)
-            unpackXtoY<uint8_t, uint32_t>(input, output, size);
-        else if (width == 2 && new_width == 4)
-            unpackXtoY<uint16_t, uint32_t>(input, output, size);
-        else if (width == 3 && new_width == 4) {
-            const uint8_t *src = static_cast<const uint8_t*>(input);
-            uint8_t *dst = static_cast<uint8_t*>(output);
-            const size_t count = *size / 3;
-            for (size_t i = 0; i < count; ++i) {
-                dst[0] = '\0';
-                dst[1] = src[0];
-                dst[2] = src[1];
-                dst[3] = src[2];
-                src += 3;
-                dst += 4;
-            }
+        } else if (width >= 1 && width <= 3 && new_width == 4) {
+            size_t count = *size / width;
+            packkernel::get().unpack[width - 1](input, output, count);
             *size = count * 4;
         } else {
             throw std::runtime_error("util::unpack(): BUG");
         }
     }
 
+    FilePositionSaver::FilePositionSaver(int fd): m_fd(fd)
+    {
+        m_saved_position = _lseeki64(m_fd, 0, SEEK_CUR);
+    }
+
+    FilePositionSaver::~FilePositionSaver()
+    {
+        _lseeki64(m_fd, m_saved_position, SEEK_SET);
+    }
+
     ssize_t nread(int fd, void *buffer, size_t size)
     {
         char *bp = static_cast<char*>(buffer);
@@ -5,6 +5,7 @@
 #include <cstring>
 #include <cwchar>
 #include <string>
+#include <vector>
 #include <sstream>
 #include <algorithm>
 #include <iterator>
@@ -12,7 +13,9 @@
 #include <cerrno>
 #include <stdint.h>
 #include <sys/stat.h>
+#if defined(_MSC_VER) || defined(__MINGW32__)
 #include <io.h>
+#endif
 #include "strutil.h"
 
 #ifdef _MSC_VER
@@ -44,6 +47,20 @@ inline int _wtoi(const wchar_t *s) { return std::wcstol(s, 0, 10); }
 #define ftello _ftelli64
 #endif
 
+/*
+ * <unistd.h> is not included here, since its getopt() clashes with
+ * wgetopt.h. Include it in the .cpp file instead.
+ */
+#if !defined(_MSC_VER) && !defined(__MINGW32__)
+#define _lseeki64 lseek
+#endif
+
+#if !defined(_MSC_VER) && !defined(__MINGW32__)
+inline uint16_t _byteswap_ushort(uint16_t n) { return __builtin_bswap16(n); }
+inline uint32_t _byteswap_ulong(uint32_t n) { return __builtin_bswap32(n); }
+inline uint64_t _byteswap_uint64(uint64_t n) { return __builtin_bswap64(n); }
+#endif
+
 namespace util {
     template <typename T, size_t size>
     inline size_t sizeof_array(const T (&)[size]) { return size; }
@@ -153,27 +170,83 @@ namespace util {
         throw std::runtime_error(ss.str());
     }
 
+    /*
+     * Growable scratch memory aligned to 32 bytes.
+     * Content is not preserved when it grows.
+     */
+    class AlignedBuffer {
+        std::vector<uint8_t> m_memory;
+        uint8_t *m_data;
+        size_t m_size;
+    public:
+        AlignedBuffer(): m_data(0), m_size(0) {}
+        uint8_t *get(size_t size)
+        {
+            if (size > m_size) {
+                /* drop the old block first, nothing to copy */
+                std::vector<uint8_t>().swap(m_memory);
+                m_memory.resize(size + 31);
+                uintptr_t p = reinterpret_cast<uintptr_t>(&m_memory[0]);
+                m_data = &m_memory[0] + ((32 - (p & 31)) & 31);
+                m_size = size;
+            }
+            return m_data;
+        }
+    };
+
     class FilePositionSaver
     {
     private:
         int m_fd;
         int64_t m_saved_position;
     public:
-        explicit FilePositionSaver(int fd): m_fd(fd)
-        {
-            m_saved_position = _lseeki64(m_fd, 0, SEEK_CUR);
-        }
-        ~FilePositionSaver()
-        {
-            _lseeki64(m_fd, m_saved_position, SEEK_SET);
-        }
+        explicit FilePositionSaver(int fd);
+        ~FilePositionSaver();
     };
 
-    void pack(void *data, size_t *size, unsigned width, unsigned new_width);
+    /*
+     * Narrow samples from width to new_width bytes, keeping the most
+     * significant bytes. output can be the same as input.
+     */
+    void pack(const void *input, void *output, size_t *size, unsigned width,
+              unsigned new_width);
 
     void unpack(const void *input, void *output, size_t *size, unsigned width,
                 unsigned new_width);
 
+    /* between nchannels planes of nsamples, and interleaved frames */
+    template <typename T>
+    void interleave(const T * const *planes, T *output,
+                    unsigned nchannels, size_t nsamples)
+    {
+        if (nchannels == 1) {
+            std::memcpy(output, planes[0], nsamples * sizeof(T));
+            return;
+        }
+        for (unsigned c = 0; c < nchannels; ++c) {
+            const T *src = planes[c];
+            T *dst = output + c;
+            for (size_t i = 0; i < nsamples; ++i, dst += nchannels)
+                *dst = src[i];
+        }
+    }
+
+    template <typename T>
+    void deinterleave(const T *input, T * const *planes,
+                      unsigned nchannels, size_t nsamples)
+    {
+        if (nchannels == 1) {
+            std::memcpy(planes[0], input, nsamples * sizeof(T));
+            return;
+        }
+        for (unsigned c = 0; c < nchannels; ++c) {
+            const T *src = input + c;
+            T *dst = planes[c];
+            for (size_t i = 0; i < nsamples; ++i, src += nchannels)
+                dst[i] = *src;
+        }
+    }
+
     ssize_t nread(int fd, void *buffer, size_t size);
 }
 
@@ -13,32 +13,53 @@
 WaveSink::WaveSink(FILE *fp,
                    uint64_t duration,
                    const AudioStreamBasicDescription &asbd,
-                   uint32_t chanmask)
-        : m_file(fp), m_bytes_written(0), m_closed(false),
-          m_seekable(false), m_chanmask(chanmask), m_asbd(asbd)
+                   uint32_t chanmask, const FlushPolicy &policy)
+        : m_file(fp), m_data_size(~0ULL), m_bytes_written(0), m_closed(false),
+          m_seekable(false), m_chanmask(chanmask), m_asbd(asbd),
+          m_policy(policy), m_last_flush(flush_clock::now())
 {
     struct stat stb = { 0 };
     if (fstat(fileno(fp), &stb))
         util::throw_crt_error("fstat()");
     m_seekable = ((stb.st_mode & S_IFMT) == S_IFREG);
+    if (!m_seekable)
+        m_pending.reserve(m_policy.mode == FlushPolicy::kBytes
+                          ? std::min<uint64_t>(m_policy.value, kMaxPending)
+                          : 1 << 20);
     std::string header = buildHeader();
 
     uint32_t hdrsize = header.size();
     uint32_t riffsize = ~0, datasize = ~0;
+    uint64_t riffsize64 = 0;
     m_rf64 = m_seekable;
+    /*
+     * With the duration known, the header is final from the start, as
+     * RF64 if it doesn't fit: no seek back is needed when the source
+     * delivers exactly that.
+     */
     if (duration != ~0ULL) {
-        uint64_t datasize64 = duration * m_bytes_per_frame;
-        uint64_t riffsize64 = hdrsize + datasize64 + 20;
-        if (riffsize64 >> 32 == 0) {
-            datasize = static_cast<uint32_t>(datasize64);
+        m_data_size = duration * m_bytes_per_frame;
+        riffsize64 = hdrsize + m_data_size + 20;
+        m_rf64 = riffsize64 >> 32 != 0;
+        if (m_rf64)
+            riffsize64 += 36;
+        else {
+            datasize = static_cast<uint32_t>(m_data_size);
             riffsize = static_cast<uint32_t>(riffsize64);
-            m_rf64 = false;
         }
     }
-    write("RIFF", 4);
+    write(m_rf64 && duration != ~0ULL ? "RF64" : "RIFF", 4);
     write(&riffsize, 4);
     write("WAVE", 4);
-    if (m_rf64) {
+    if (m_rf64 && duration != ~0ULL) {
+        uint32_t ds64size = 28, table = 0;
+        write("ds64", 4);
+        write(&ds64size, 4);
+        write(&riffsize64, 8);
+        write(&m_data_size, 8);
+        write(&duration, 8);
+        write(&table, 4);
+    } else if (m_rf64) {
         write("JUNK", 4);
         static const char filler[32] = { 0x1c, 0 };
         write(filler, 32);
@@ -49,7 +70,8 @@ WaveSink::WaveSink(FILE *fp,
     write("data", 4);
     write(&datasize, 4);
     m_data_pos = 28 + hdrsize + (m_rf64 ? 36 : 0);
-    if (!m_seekable) std::fflush(fp);
+    if (!m_seekable && m_policy.mode == FlushPolicy::kEveryWrite)
+        flush();
 }
 
 std::string WaveSink::buildHeader()
@@ -95,26 +117,54 @@ std::string WaveSink::buildHeader()
     return oss.str();
 }
 
-void WaveSink::writeSamples(const void *data, size_t length, size_t nsamples)
+void WaveSink::writeSamples(const void *data, size_t length, size_t)
 {
-    uint8_t *bp = static_cast<uint8_t *>(const_cast<void*>(data));
-    std::vector<uint8_t> buf;
-    if (m_bytes_per_frame < m_asbd.mBytesPerFrame) {
+    const uint8_t *bp = static_cast<const uint8_t *>(data);
+    bool flip = m_asbd.mBitsPerChannel <= 8 &&
+                m_asbd.mFormatFlags & kAudioFormatFlagIsSignedInteger;
+    if (m_bytes_per_frame < m_asbd.mBytesPerFrame || flip) {
         unsigned obpc = m_asbd.mBytesPerFrame / m_asbd.mChannelsPerFrame;
         unsigned nbpc = m_bytes_per_frame / m_asbd.mChannelsPerFrame;
-        util::pack(bp, &length, obpc, nbpc);
-    }
-    if (m_asbd.mBitsPerChannel <= 8 &&
-        m_asbd.mFormatFlags & kAudioFormatFlagIsSignedInteger) {
-        buf.resize(length);
-        bp = &buf[0];
-        std::memcpy(bp, data, length);
-        for (size_t i = 0; i < length; ++i)
-            bp[i] ^= 0x80;
+        uint8_t *sp = m_scratch.get(length);
+        util::pack(bp, sp, &length, obpc, nbpc);
+        if (flip)
+            for (size_t i = 0; i < length; ++i)
+                sp[i] ^= 0x80;
+        bp = sp;
     }
     write(bp, length);
     m_bytes_written += length;
-    if (!m_seekable) std::fflush(m_file);
+    if (!m_seekable && needsFlush())
+        flush();
+}
+
+bool WaveSink::needsFlush() const
+{
+    if (m_pending.size() >= kMaxPending)
+        return true;
+    switch (m_policy.mode) {
+    case FlushPolicy::kEveryWrite:
+        return true;
+    case FlushPolicy::kBytes:
+        return m_pending.size() >= m_policy.value;
+    case FlushPolicy::kInterval:
+        return flush_clock::now() - m_last_flush >=
+            std::chrono::milliseconds(m_policy.value);
+    default:
+        return false;
+    }
+}
+
+void WaveSink::flush()
+{
+    m_last_flush = flush_clock::now();
+    if (m_pending.size()) {
+        std::fwrite(&m_pending[0], 1, m_pending.size(), m_file);
+        m_pending.clear();
+    }
+    std::fflush(m_file);
+    if (ferror(m_file))
+        util::throw_crt_error("fwrite()");
 }
 
 void WaveSink::finishWrite()
@@ -122,10 +172,17 @@ void WaveSink::finishWrite()
     if (m_closed) return;
     m_closed = true;
     if (m_bytes_written & 1) write("\0", 1);
-    if (!m_seekable) return;
+    if (!m_seekable) {
+        flush();
+        return;
+    }
+    if (m_bytes_written == m_data_size)
+        return;
     uint64_t datasize64 = m_bytes_written;
     uint64_t riffsize64 = datasize64 + m_data_pos - 8;
-    if (riffsize64 >> 32 == 0) {
+    /* already RF64 when the duration given was too long for RIFF */
+    bool ds64 = m_rf64 && m_data_size != ~0ULL;
+    if (riffsize64 >> 32 == 0 && !ds64) {
         if (std::fseek(m_file, m_data_pos - 4, SEEK_SET) == 0) {
             uint32_t size32 = static_cast<uint32_t>(datasize64);
             write(&size32, 4);
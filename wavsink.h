@@ -1,9 +1,31 @@
 #ifndef _WAVESINK_H
 #define _WAVESINK_H
 
+#include <chrono>
 #include "iointer.h"
+#include "util.h"
+
+/*
+ * When a non-seekable output (pipe) is flushed. In between, data is kept
+ * in a userspace buffer and written with one fwrite() per flush.
+ * Seekable outputs are left to stdio buffering.
+ */
+struct FlushPolicy {
+    enum Mode {
+        kEveryWrite,    /* after each writeSamples(), lowest latency */
+        kBytes,         /* when value bytes are pending */
+        kInterval,      /* when value msecs have passed since the last one */
+        kAtEnd          /* only when the buffer is full, and at the end */
+    };
+    Mode mode;
+    uint64_t value;
+    FlushPolicy(Mode mode=kBytes, uint64_t value=1 << 20)
+        : mode(mode), value(value)
+    {}
+};
 
 class WaveSink : public ISink {
+    typedef std::chrono::steady_clock flush_clock;
     FILE *m_file;
     bool m_closed;
     bool m_seekable;
@@ -11,12 +33,21 @@ class WaveSink : public ISink {
     uint16_t m_bytes_per_frame;
     uint32_t m_chanmask;
     uint32_t m_data_pos;
+    /* data size written in the header, ~0 if unknown */
+    uint64_t m_data_size;
     uint64_t m_bytes_written;
     AudioStreamBasicDescription m_asbd;
+    FlushPolicy m_policy;
+    std::vector<uint8_t> m_pending;
+    util::AlignedBuffer m_scratch;
+    flush_clock::time_point m_last_flush;
 public:
+    /* pending data is always flushed beyond this */
+    enum { kMaxPending = 16 << 20 };
+
     WaveSink(FILE *fp, uint64_t duration,
              const AudioStreamBasicDescription &format,
-             uint32_t chanmask=0);
+             uint32_t chanmask=0, const FlushPolicy &policy=FlushPolicy());
     ~WaveSink() { try { finishWrite(); } catch (...) {} }
     void writeSamples(const void *data, size_t length, size_t nsamples);
     void finishWrite();
@@ -29,10 +60,17 @@ private:
     std::string buildHeader();
     void write(const void *data, size_t length)
     {
+        if (!m_seekable) {
+            const uint8_t *bp = static_cast<const uint8_t*>(data);
+            m_pending.insert(m_pending.end(), bp, bp + length);
+            return;
+        }
         std::fwrite(data, 1, length, m_file);
         if (ferror(m_file))
             util::throw_crt_error("fwrite()");
     }
+    bool needsFlush() const;
+    void flush();
 };
 
 #endif
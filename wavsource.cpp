@@ -1,12 +1,13 @@
 #include <cstring>
 #include <limits>
 #include <assert.h>
-#include <io.h>
 #include <fcntl.h>
 #include <sys/stat.h>
+#if !defined(_MSC_VER) && !defined(__MINGW32__)
+#include <unistd.h>
+#endif
 #include "wavsource.h"
 #include "util.h"
-#include "win32util.h"
 #include "chanmap.h"
 
 #define FOURCCR(a,b,c,d) ((a)|((b)<<8)|((c)<<16)|((d)<<24))
@@ -30,8 +31,16 @@ WaveSource::WaveSource(const std::shared_ptr<FILE> &fp, bool ignorelength)
         m_length = ~0ULL;
     else
         m_length = data_length / m_block_align;
-    if (m_seekable)
+    if (m_seekable) {
         m_data_pos = _lseeki64(fd(), 0, SEEK_CUR);
+        try {
+            m_map = std::make_shared<MappedFile>(fd());
+            m_map->adviseSequential();
+        } catch (...) {
+            /* e.g. no room in the address space; just read() then */
+            m_map.reset();
+        }
+    }
 }
 
 size_t WaveSource::readSamples(void *buffer, size_t nsamples)
@@ -40,6 +49,8 @@ size_t WaveSource::readSamples(void *buffer, size_t nsamples)
         nsamples = static_cast<size_t>(std::min(static_cast<uint64_t>(nsamples),
                                                 m_length - m_position));
     }
+    if (m_map)
+        return readMapped(buffer, nsamples);
     ssize_t nbytes = nsamples * m_block_align;
     m_buffer.resize(nbytes);
     nbytes = util::nread(fd(), &m_buffer[0], nbytes);
@@ -59,6 +70,33 @@ size_t WaveSource::readSamples(void *buffer, size_t nsamples)
     }
     return nsamples;
 }
+
+/* unpack straight from the mapping into the output */
+size_t WaveSource::readMapped(void *buffer, size_t nsamples)
+{
+    uint64_t end = (m_map->size() - std::min<uint64_t>(m_map->size(),
+                                                       m_data_pos))
+                   / m_block_align;
+    if (m_position >= static_cast<int64_t>(end))
+        return 0;
+    nsamples = static_cast<size_t>(std::min<uint64_t>(nsamples,
+                                                      end - m_position));
+    const uint8_t *bp = m_map->data() + m_data_pos
+                      + m_position * m_block_align;
+    size_t size = nsamples * m_block_align;
+    util::unpack(bp, buffer, &size,
+                 m_block_align / m_asbd.mChannelsPerFrame,
+                 m_asbd.mBytesPerFrame / m_asbd.mChannelsPerFrame);
+    /* convert to signed; the byte is now at the top of the int32 */
+    if (m_asbd.mBitsPerChannel <= 8) {
+        uint32_t *ip = static_cast<uint32_t*>(buffer);
+        for (size_t i = 0; i < size / 4; ++i)
+            ip[i] ^= 0x80000000;
+    }
+    m_position += nsamples;
+    return nsamples;
+}
+
 void WaveSource::seekTo(int64_t count)
 {
     if (m_seekable) {
@@ -73,7 +111,7 @@ void WaveSource::seekTo(int64_t count)
         int64_t nread = 0;
         int64_t bytes = (count - m_position) * m_block_align;
         while (nread < bytes) {
-            int n = util::nread(fd(), buf, std::min(bytes - nread, 0x1000LL));
+            int n = util::nread(fd(), buf, std::min<int64_t>(bytes - nread, 0x1000));
             if (n < 0) break;
             nread += n;
         }
@@ -132,7 +170,7 @@ void WaveSource::skip(int64_t n)
     else {
         char buf[8192];
         while (n > 0) {
-            int nn = static_cast<int>(std::min(n, 8192LL));
+            int nn = static_cast<int>(std::min<int64_t>(n, 8192));
             util::check_eof(util::nread(fd(), buf, nn) == nn);
             n -= nn;
         }
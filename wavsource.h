@@ -3,6 +3,7 @@
 
 #include "iointer.h"
 #include "cautil.h"
+#include "mmapfile.h"
 
 namespace wave {
     struct GUID {
@@ -24,6 +25,7 @@ class WaveSource: public ISeekableSource {
     std::shared_ptr<FILE> m_fp;
     std::vector<uint32_t> m_chanmap;
     std::vector<uint8_t> m_buffer;
+    std::shared_ptr<MappedFile> m_map;
     AudioStreamBasicDescription m_asbd;
 public:
     WaveSource(const std::shared_ptr<FILE> &fp, bool ignorelength = false);
@@ -40,7 +42,10 @@ public:
     size_t readSamples(void *buffer, size_t nsamples);
     bool isSeekable() { return util::is_seekable(fileno(m_fp.get())); }
     void seekTo(int64_t count);
+    /* regular files are read through a memory mapping when possible */
+    bool isMapped() const { return m_map.get() != 0; }
 private:
+    size_t readMapped(void *buffer, size_t nsamples);
     int fd() { return fileno(m_fp.get()); }
     int64_t parse();
     void read16le(void *n);